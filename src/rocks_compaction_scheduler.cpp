@@ -28,27 +28,214 @@
 
 #define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
 
+#include <algorithm>
 #include <deque>
 
 #include "mongo/platform/basic.h"
 
 #include "rocks_compaction_scheduler.h"
 
+#include "mongo/bson/bsonobjbuilder.h"
 #include "mongo/db/client.h"
+#include "mongo/db/operation_context.h"
 #include "mongo/stdx/condition_variable.h"
 #include "mongo/stdx/mutex.h"
 #include "mongo/util/assert_util.h"
 #include "mongo/util/background.h"
 #include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+#include "mongo/util/time_support.h"
 #include "rocks_util.h"
 
 #include <rocksdb/convenience.h>
 #include <rocksdb/db.h>
 #include <rocksdb/experimental.h>
 #include <rocksdb/slice.h>
+#include <rocksdb/version.h>
 
 namespace mongo {
 
+    namespace {
+        // target amount of SST data compacted between two progress updates / cancellation checks
+        const uint64_t kCompactionChunkBytes = 256 * 1024 * 1024;
+
+        // Splits [begin, end) at SST file boundaries into chunks of roughly
+        // kCompactionChunkBytes. Files are attributed to the chunk their smallest key falls into.
+        template <class Chunk>
+        std::vector<Chunk> splitAtFileBoundaries(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                                 const std::string& begin,
+                                                 const std::string& end) {
+            if (cf == nullptr) {
+                cf = db->DefaultColumnFamily();
+            }
+            const rocksdb::Comparator* cmp = db->GetOptions(cf).comparator;
+
+            std::vector<rocksdb::LiveFileMetaData> files;
+            db->GetLiveFilesMetaData(&files);
+
+            std::vector<std::pair<std::string, uint64_t>> starts;
+            uint64_t firstChunkBytes = 0;
+            for (const auto& file : files) {
+                if (file.column_family_name != cf->GetName()) {
+                    continue;
+                }
+                if ((!begin.empty() && cmp->Compare(file.largestkey, begin) < 0) ||
+                    (!end.empty() && cmp->Compare(file.smallestkey, end) >= 0)) {
+                    continue;
+                }
+                if (begin.empty() || cmp->Compare(file.smallestkey, begin) > 0) {
+                    starts.emplace_back(file.smallestkey, file.size);
+                } else {
+                    firstChunkBytes += file.size;
+                }
+            }
+            std::sort(starts.begin(), starts.end(),
+                      [cmp](const std::pair<std::string, uint64_t>& a,
+                            const std::pair<std::string, uint64_t>& b) {
+                          return cmp->Compare(a.first, b.first) < 0;
+                      });
+
+            std::vector<Chunk> chunks;
+            uint64_t chunkBytes = firstChunkBytes;
+            for (const auto& start : starts) {
+                if (chunkBytes >= kCompactionChunkBytes &&
+                    (chunks.empty() || cmp->Compare(chunks.back().end, start.first) < 0)) {
+                    chunks.push_back({start.first, chunkBytes});
+                    chunkBytes = 0;
+                }
+                chunkBytes += start.second;
+            }
+            chunks.push_back({end, chunkBytes});
+            return chunks;
+        }
+    }  // namespace
+
+    RocksCompactionTask::RocksCompactionTask(uint64_t id, std::string description,
+                                             rocksdb::ColumnFamilyHandle* cf, std::string begin,
+                                             std::string end)
+        : _id(id),
+          _description(std::move(description)),
+          _cf(cf),
+          _begin(std::move(begin)),
+          _end(std::move(end)) {}
+
+    bool RocksCompactionTask::waitUntilDone(stdx::chrono::milliseconds timeout) {
+        stdx::unique_lock<stdx::mutex> lk(_mutex);
+        return _doneCV.wait_for(lk, timeout, [this] { return _done; });
+    }
+
+    Status RocksCompactionTask::getStatus() const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        invariant(_done);
+        return _status;
+    }
+
+    bool RocksCompactionTask::isDone() const {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        return _done;
+    }
+
+    void RocksCompactionTask::appendTo(BSONArrayBuilder* builder) const {
+        BSONObjBuilder b(builder->subobjStart());
+        b.append("id", static_cast<long long>(_id));
+        b.append("description", _description);
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            if (_done) {
+                b.append("state", _status.isOK() ? "done" : "failed");
+                if (!_status.isOK()) {
+                    b.append("error", _status.toString());
+                }
+            } else if (_running.load()) {
+                b.append("state", isCanceled() ? "canceling" : "running");
+            } else {
+                b.append("state", "queued");
+            }
+        }
+        b.append("estimated-bytes", static_cast<long long>(estimatedBytes()));
+        b.append("processed-bytes", static_cast<long long>(processedBytes()));
+        const unsigned long long startMicros = _startMicros.load();
+        if (startMicros != 0) {
+            unsigned long long endMicros = _endMicros.load();
+            if (endMicros == 0) {
+                endMicros = curTimeMicros64();
+            }
+            b.append("elapsed-millis",
+                     static_cast<long long>(endMicros > startMicros
+                                                ? (endMicros - startMicros) / 1000
+                                                : 0));
+        }
+    }
+
+    bool RocksCompactionTask::_compactNextChunk(rocksdb::DB* db) {
+        if (!_running.load()) {
+            if (isCanceled()) {
+                _finish(Status(ErrorCodes::Interrupted, "compaction canceled"));
+                return true;
+            }
+            _startMicros.store(curTimeMicros64());
+            _chunks = splitAtFileBoundaries<Chunk>(db, _cf, _begin, _end);
+            uint64_t estimatedBytes = 0;
+            for (const auto& chunk : _chunks) {
+                estimatedBytes += chunk.bytes;
+            }
+            _estimatedBytes.store(estimatedBytes);
+            _running.store(true);
+            log() << "starting compaction of " << _description << ", " << _chunks.size()
+                  << " chunks, " << estimatedBytes << " bytes";
+        }
+
+        if (isCanceled()) {
+            log() << "compaction of " << _description << " canceled after " << processedBytes()
+                  << " of " << estimatedBytes() << " bytes";
+            _finish(Status(ErrorCodes::Interrupted, "compaction canceled"));
+            return true;
+        }
+
+        rocksdb::CompactRangeOptions compact_options;
+        compact_options.bottommost_level_compaction = rocksdb::BottommostLevelCompaction::kForce;
+        compact_options.exclusive_manual_compaction = false;
+#if ROCKSDB_MAJOR > 6 || (ROCKSDB_MAJOR == 6 && ROCKSDB_MINOR >= 5)
+        // split each chunk into subcompactions executed by the background compaction threads
+        compact_options.max_subcompactions =
+            static_cast<uint32_t>(std::max(1, db->GetDBOptions().max_background_compactions));
+#endif
+
+        rocksdb::ColumnFamilyHandle* cf = _cf ? _cf : db->DefaultColumnFamily();
+        const std::string& chunkBegin = _nextChunk == 0 ? _begin : _chunks[_nextChunk - 1].end;
+        const Chunk& chunk = _chunks[_nextChunk];
+        rocksdb::Slice start_slice(chunkBegin);
+        rocksdb::Slice end_slice(chunk.end);
+        auto s = db->CompactRange(compact_options, cf,
+                                  !chunkBegin.empty() ? &start_slice : nullptr,
+                                  !chunk.end.empty() ? &end_slice : nullptr);
+        if (!s.ok()) {
+            log() << "failed to compact " << _description << ": " << s.ToString();
+            _finish(rocksToMongoStatus(s));
+            return true;
+        }
+        _processedBytes.fetch_add(chunk.bytes);
+
+        if (++_nextChunk < _chunks.size()) {
+            return false;
+        }
+        log() << "finished compaction of " << _description << " in "
+              << (curTimeMicros64() - _startMicros.load()) / 1000 << "ms";
+        _finish(Status::OK());
+        return true;
+    }
+
+    void RocksCompactionTask::_finish(Status status) {
+        _endMicros.store(curTimeMicros64());
+        {
+            stdx::lock_guard<stdx::mutex> lk(_mutex);
+            _done = true;
+            _status = std::move(status);
+        }
+        _running.store(false);
+        _doneCV.notify_all();
+    }
+
     class CompactionBackgroundJob : public BackgroundJob {
     public:
         CompactionBackgroundJob(rocksdb::DB* db);
@@ -57,6 +244,7 @@ namespace mongo {
         // schedule compact range operation for execution in _compactionThread
         Status scheduleCompactOp(const std::string& begin = std::string(), const std::string& end = std::string(),
                                  bool rangeDropped = false, const std::function<void(bool)>& cleanup = std::function<void(bool)>());
+        Status scheduleCompactTask(std::shared_ptr<RocksCompactionTask> task);
 
     private:
         // struct with compaction operation data
@@ -67,6 +255,8 @@ namespace mongo {
             std::string _end_str;
             bool _rangeDropped;
             std::function<void(bool)> _cleanup;
+            // set for user requested compactions, which ignore the fields above
+            std::shared_ptr<RocksCompactionTask> _task;
         };
 
         static const char * const _name;
@@ -94,6 +284,12 @@ namespace mongo {
         {
             stdx::lock_guard<stdx::mutex> lk(_compactionMutex);
             _compactionThreadRunning = false;
+            for (const auto& op : _compactionQueue) {
+                if (op._task) {
+                    op._task->_finish(
+                        Status(ErrorCodes::ShutdownInProgress, "compaction thread terminating"));
+                }
+            }
             _compactionQueue.clear();
         }
 // From 4.13 public release, CancelAllBackgroundWork() flushes all memtables for databases
@@ -135,13 +331,34 @@ namespace mongo {
             if (_compactionQueue.empty())
                 _compactionWakeUp.wait(lk);
             else {
-                // get item from queue
-                const CompactOp op(std::move(_compactionQueue.front()));
-                _compactionQueue.pop_front();
-                // unlock mutex for the time of compaction
-                unlock_guard<decltype(lk)> rlk(lk);
-                // do compaction
-                op.doCompact(_db);
+                // Compactions of dropped ranges and of tombstones go first, user requested tasks
+                // only get to compact one chunk at a time
+                auto it = std::find_if(_compactionQueue.begin(), _compactionQueue.end(),
+                                       [](const CompactOp& op) { return !op._task; });
+                if (it == _compactionQueue.end()) {
+                    it = _compactionQueue.begin();
+                }
+                CompactOp op(std::move(*it));
+                _compactionQueue.erase(it);
+                bool taskDone = true;
+                {
+                    // unlock mutex for the time of compaction
+                    unlock_guard<decltype(lk)> rlk(lk);
+                    // do compaction
+                    if (op._task) {
+                        taskDone = op._task->_compactNextChunk(_db);
+                    } else {
+                        op.doCompact(_db);
+                    }
+                }
+                if (!taskDone) {
+                    if (_compactionThreadRunning) {
+                        _compactionQueue.push_back(std::move(op));
+                    } else {
+                        op._task->_finish(
+                            Status(ErrorCodes::ShutdownInProgress, "compaction thread terminating"));
+                    }
+                }
             }
         }
         lk.unlock();
@@ -152,7 +369,20 @@ namespace mongo {
                                                        bool rangeDropped, const std::function<void(bool)>& cleanup) {
         {
             stdx::lock_guard<stdx::mutex> lk(_compactionMutex);
-            _compactionQueue.push_back({begin, end, rangeDropped, cleanup});
+            _compactionQueue.push_back({begin, end, rangeDropped, cleanup, nullptr});
+        }
+        _compactionWakeUp.notify_one();
+        return Status::OK();
+    }
+
+    Status CompactionBackgroundJob::scheduleCompactTask(std::shared_ptr<RocksCompactionTask> task) {
+        {
+            stdx::lock_guard<stdx::mutex> lk(_compactionMutex);
+            if (!_compactionThreadRunning) {
+                return Status(ErrorCodes::ShutdownInProgress, "compaction thread terminating");
+            }
+            _compactionQueue.push_back(
+                {std::string(), std::string(), false, std::function<void(bool)>(), std::move(task)});
         }
         _compactionWakeUp.notify_one();
         return Status::OK();
@@ -229,6 +459,80 @@ namespace mongo {
         return compactRange(prefix, rocksGetNextPrefix(prefix));
     }
 
+    std::shared_ptr<RocksCompactionTask> RocksCompactionScheduler::compactRangeTask(
+        const std::string& description, rocksdb::ColumnFamilyHandle* cf, const std::string& begin,
+        const std::string& end) {
+        std::shared_ptr<RocksCompactionTask> task;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_lock);
+            task = std::make_shared<RocksCompactionTask>(_nextTaskId++, description, cf, begin,
+                                                         end);
+            _pruneFinishedTasks_inlock();
+            _tasks.push_back(task);
+        }
+        auto s = _compactionJob->scheduleCompactTask(task);
+        if (!s.isOK()) {
+            task->_finish(s);
+        }
+        return task;
+    }
+
+    void RocksCompactionScheduler::_pruneFinishedTasks_inlock() {
+        size_t finished = 0;
+        for (const auto& task : _tasks) {
+            if (task->isDone()) {
+                ++finished;
+            }
+        }
+        for (auto it = _tasks.begin(); it != _tasks.end() && finished > kMaxFinishedTasks;) {
+            if ((*it)->isDone()) {
+                it = _tasks.erase(it);
+                --finished;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    Status RocksCompactionScheduler::waitForCompaction(
+        OperationContext* opCtx, const std::shared_ptr<RocksCompactionTask>& task) {
+        while (!task->waitUntilDone(stdx::chrono::milliseconds(100))) {
+            auto interruptStatus = opCtx->checkForInterruptNoAssert();
+            if (!interruptStatus.isOK()) {
+                task->cancel();
+                // the compaction thread stops at the next chunk boundary
+                while (!task->waitUntilDone(stdx::chrono::milliseconds(100))) {
+                }
+                return interruptStatus;
+            }
+        }
+        return task->getStatus();
+    }
+
+    Status RocksCompactionScheduler::cancelCompactionTask(uint64_t id) {
+        stdx::lock_guard<stdx::mutex> lk(_lock);
+        bool found = false;
+        for (const auto& task : _tasks) {
+            if (id == 0 || task->id() == id) {
+                task->cancel();
+                found = true;
+            }
+        }
+        if (!found && id != 0) {
+            return Status(ErrorCodes::NoSuchKey,
+                          str::stream() << "no compaction task with id " << id);
+        }
+        return Status::OK();
+    }
+
+    void RocksCompactionScheduler::appendCompactionTasks(BSONArrayBuilder* builder) {
+        stdx::lock_guard<stdx::mutex> lk(_lock);
+        _pruneFinishedTasks_inlock();
+        for (const auto& task : _tasks) {
+            task->appendTo(builder);
+        }
+    }
+
     Status RocksCompactionScheduler::compactDroppedRange(const std::string& start, const std::string& end,
                                                          const std::function<void(bool)>& cleanup) {
         return _compactionJob->scheduleCompactOp(start, end, true, cleanup);
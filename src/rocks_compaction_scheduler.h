@@ -28,20 +28,95 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
+#include <list>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <rocksdb/db.h>
 #include <rocksdb/slice.h>
 
 #include "mongo/base/status.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/stdx/condition_variable.h"
 #include "mongo/stdx/mutex.h"
 #include "mongo/util/timer.h"
 
 namespace mongo {
 
+    class BSONArrayBuilder;
     class CompactionBackgroundJob;
+    class OperationContext;
+
+    /**
+     * A user requested compaction of a key range, e.g. of a single collection or index. It's
+     * executed by the compaction thread in chunks split at SST file boundaries, so it reports
+     * progress after every chunk and can be canceled between chunks. Other compactions queued
+     * in the meantime run before the next chunk.
+     */
+    class RocksCompactionTask {
+    public:
+        RocksCompactionTask(uint64_t id, std::string description, rocksdb::ColumnFamilyHandle* cf,
+                            std::string begin, std::string end);
+
+        uint64_t id() const { return _id; }
+        const std::string& description() const { return _description; }
+
+        // Stops the task after the chunk that is currently being compacted
+        void cancel() { _canceled.store(true); }
+        bool isCanceled() const { return _canceled.load(); }
+
+        // Returns true if the task finished within the timeout
+        bool waitUntilDone(stdx::chrono::milliseconds timeout);
+        // Only valid once the task is done
+        Status getStatus() const;
+
+        uint64_t estimatedBytes() const { return _estimatedBytes.load(); }
+        uint64_t processedBytes() const { return _processedBytes.load(); }
+
+        bool isDone() const;
+
+        void appendTo(BSONArrayBuilder* builder) const;
+
+    private:
+        friend class CompactionBackgroundJob;
+        friend class RocksCompactionScheduler;
+
+        struct Chunk {
+            std::string end;  // empty means end of the range
+            uint64_t bytes;
+        };
+
+        // Compacts the next chunk, returns true once the task is done
+        bool _compactNextChunk(rocksdb::DB* db);
+        void _finish(Status status);
+
+        const uint64_t _id;
+        const std::string _description;
+        rocksdb::ColumnFamilyHandle* const _cf;  // not owned, nullptr for the default CF
+        const std::string _begin;
+        const std::string _end;
+
+        std::atomic<bool> _canceled{false};
+        std::atomic<bool> _running{false};
+        std::atomic<uint64_t> _estimatedBytes{0};
+        std::atomic<uint64_t> _processedBytes{0};
+        // time spent queued doesn't count
+        std::atomic<unsigned long long> _startMicros{0};
+        std::atomic<unsigned long long> _endMicros{0};
+
+        // only used by the compaction thread
+        std::vector<Chunk> _chunks;
+        size_t _nextChunk = 0;
+
+        mutable stdx::mutex _mutex;
+        stdx::condition_variable _doneCV;
+        // protected by _mutex
+        bool _done = false;
+        Status _status = Status::OK();
+    };
 
     class RocksCompactionScheduler {
     public:
@@ -60,7 +135,29 @@ namespace mongo {
                                    const std::function<void(bool)>& cleanup);
         Status compactDroppedPrefix(const std::string& prefix, const std::function<void(bool)>& cleanup);
 
+        // schedule a cancellable compaction of [begin, end) that reports its progress. cf can be
+        // nullptr for the default column family
+        std::shared_ptr<RocksCompactionTask> compactRangeTask(const std::string& description,
+                                                              rocksdb::ColumnFamilyHandle* cf,
+                                                              const std::string& begin,
+                                                              const std::string& end);
+
+        // Waits for the task to finish. If the operation gets killed or interrupted, the task is
+        // canceled and the interruption status is returned.
+        Status waitForCompaction(OperationContext* opCtx,
+                                 const std::shared_ptr<RocksCompactionTask>& task);
+
+        // Cancels the task with the given id, or all tasks if id is 0
+        Status cancelCompactionTask(uint64_t id);
+
+        // Appends the progress of the compaction tasks that are running or queued, and of the
+        // last few that finished
+        void appendCompactionTasks(BSONArrayBuilder* builder);
+
     private:
+        // Forgets the oldest finished tasks beyond kMaxFinishedTasks
+        void _pruneFinishedTasks_inlock();
+
         stdx::mutex _lock;
         // protected by _lock
         Timer _timer;
@@ -71,6 +168,13 @@ namespace mongo {
         // deletions it had to skip over (this is about 10ms extra overhead)
         static const int kSkippedDeletionsThreshold = 50000;
 
+        // how many finished tasks we keep around for appendCompactionTasks()
+        static const size_t kMaxFinishedTasks = 16;
+
+        // protected by _lock, in the order they were scheduled
+        std::list<std::shared_ptr<RocksCompactionTask>> _tasks;
+        uint64_t _nextTaskId = 1;
+
         // thread for async execution of range compactions
         std::unique_ptr<CompactionBackgroundJob> _compactionJob;
     };
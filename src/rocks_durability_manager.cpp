@@ -26,7 +26,11 @@
  *    it in the license file.
  */
 
+#include <algorithm>
+
+#include "mongo/bson/bsonobjbuilder.h"
 #include "mongo/db/storage/journal_listener.h"
+#include "mongo/util/time_support.h"
 
 #include <rocksdb/db.h>
 
@@ -35,7 +39,12 @@
 
 namespace mongo {
     RocksDurabilityManager::RocksDurabilityManager(rocksdb::DB* db, bool durable)
-        : _db(db), _durable(durable), _journalListener(&NoOpJournalListener::instance) {}
+        : _db(db),
+          _durable(durable),
+          _journalListener(&NoOpJournalListener::instance),
+          _syncInProgress(false),
+          _syncedSequenceNumber(0),
+          _numWaiters(0) {}
 
     void RocksDurabilityManager::setJournalListener(JournalListener* jl) {
         stdx::unique_lock<stdx::mutex> lk(_journalListenerMutex);
@@ -43,14 +52,66 @@ namespace mongo {
     }
 
     void RocksDurabilityManager::waitUntilDurable(bool forceFlush) {
-        stdx::unique_lock<stdx::mutex> lk(_journalListenerMutex);
-        JournalListener::Token token = _journalListener->getToken();
         if (!_durable || forceFlush) {
+            stdx::unique_lock<stdx::mutex> lk(_journalListenerMutex);
+            JournalListener::Token token = _journalListener->getToken();
             invariantRocksOK(_db->Flush(rocksdb::FlushOptions()));
-        } else {
+            _journalListener->onDurable(token);
+            return;
+        }
+
+        // Everything the token covers is in the WAL up to this sequence number, since the token
+        // is taken first. A sync that starts after this point covers it.
+        stdx::unique_lock<stdx::mutex> listenerLock(_journalListenerMutex);
+        const JournalListener::Token token = _journalListener->getToken();
+        const uint64_t neededSequenceNumber = _db->GetLatestSequenceNumber();
+        listenerLock.unlock();
+
+        stdx::unique_lock<stdx::mutex> lk(_syncMutex);
+        ++_numWaiters;
+        while (_syncedSequenceNumber < neededSequenceNumber) {
+            if (_syncInProgress) {
+                // the running sync might have started before our writes, check again when it's
+                // done
+                _syncDone.wait(lk);
+                continue;
+            }
+            _syncInProgress = true;
+            const int groupSize = _numWaiters;
+            lk.unlock();
+
+            const unsigned long long startMicros = curTimeMicros64();
+            const uint64_t syncedSequenceNumber = _db->GetLatestSequenceNumber();
             invariantRocksOK(_db->SyncWAL());
+            _syncLatencyMicros.record(curTimeMicros64() - startMicros);
+            _syncGroupSize.record(groupSize);
+
+            lk.lock();
+            _syncedSequenceNumber = std::max(_syncedSequenceNumber, syncedSequenceNumber);
+            _syncInProgress = false;
+            _syncDone.notify_all();
         }
+        --_numWaiters;
+        lk.unlock();
+
+        // Whether we synced, waited for someone else's sync or found our writes already synced,
+        // the listener learns about it. Listeners only move their durable point forward, so
+        // concurrent callers reporting out of order is fine.
+        listenerLock.lock();
         _journalListener->onDurable(token);
     }
 
+    void RocksDurabilityManager::appendSyncStats(BSONObjBuilder* builder) const {
+        {
+            BSONObjBuilder latencyBuilder(builder->subobjStart("latency-micros"));
+            _syncLatencyMicros.appendTo(&latencyBuilder);
+            latencyBuilder.done();
+        }
+        {
+            BSONObjBuilder groupSizeBuilder(builder->subobjStart("group-size"));
+            _syncGroupSize.appendTo(&groupSizeBuilder);
+            groupSizeBuilder.done();
+        }
+    }
+
 } // namespace mongo
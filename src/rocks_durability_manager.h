@@ -30,7 +30,13 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include "mongo/base/disallow_copying.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+
+#include "rocks_histogram.h"
 
 namespace rocksdb {
     class DB;
@@ -38,6 +44,7 @@ namespace rocksdb {
 
 namespace mongo {
 
+    class BSONObjBuilder;
     class JournalListener;
 
     class RocksDurabilityManager {
@@ -48,15 +55,33 @@ namespace mongo {
 
         void setJournalListener(JournalListener* jl);
 
+        // Returns once everything written before the call is in the journal. Concurrent callers
+        // share a sync: one of them syncs the WAL while the others wait for the result, and
+        // callers whose writes are already synced return right away.
         void waitUntilDurable(bool forceFlush);
 
+        // Appends the latency and group size histograms of WAL syncs
+        void appendSyncStats(BSONObjBuilder* builder) const;
+
     private:
         rocksdb::DB* _db;  // not owned
         bool _durable;
         // Notified when we commit to the journal.
         JournalListener* _journalListener;
-        // Protects _journalListener.
+        // Protects _journalListener
         stdx::mutex _journalListenerMutex;
+
+        // Protects the members below
+        stdx::mutex _syncMutex;
+        // notified when a sync finishes
+        stdx::condition_variable _syncDone;
+        bool _syncInProgress;
+        // every write with a sequence number up to this one is synced
+        uint64_t _syncedSequenceNumber;
+        int _numWaiters;
+
+        RocksHistogram _syncLatencyMicros;
+        RocksHistogram _syncGroupSize;
     };
 
 } // namespace mongo
@@ -35,6 +35,7 @@
 #include "rocks_engine.h"
 
 #include <algorithm>
+#include <cstring>
 #include <mutex>
 
 #include <boost/filesystem/operations.hpp>
@@ -46,6 +47,7 @@
 #include <rocksdb/db.h>
 #include <rocksdb/experimental.h>
 #include <rocksdb/slice.h>
+#include <rocksdb/slice_transform.h>
 #include <rocksdb/options.h>
 #include <rocksdb/rate_limiter.h>
 #include <rocksdb/table.h>
@@ -75,6 +77,7 @@
 #include "rocks_record_store.h"
 #include "rocks_recovery_unit.h"
 #include "rocks_index.h"
+#include "rocks_sst_bulk_loader.h"
 #include "rocks_util.h"
 
 #define ROCKS_TRACE log()
@@ -201,6 +204,45 @@ namespace mongo {
             const RocksEngine* _engine;
         };
 
+        // Extracts <prefix><KeyString up to and including the first kEnd byte> from index keys,
+        // i.e. the key without its RecordId, so that all entries of an index key share one
+        // prefix bloom entry. The result depends only on the key bytes, never on which ident the
+        // key belongs to, so it stays consistent across restarts and SST files. A kEnd byte can
+        // also appear inside an encoded value (or a record key), in which case the prefix is just
+        // shorter and less selective, but still correct.
+        class KeyStringPrefixExtractor : public rocksdb::SliceTransform {
+        public:
+            virtual const char* Name() const override {
+                return "mongo.rocks.KeyStringPrefixExtractor";
+            }
+
+            virtual rocksdb::Slice Transform(const rocksdb::Slice& key) const override {
+                return rocksdb::Slice(key.data(), _prefixSize(key));
+            }
+
+            virtual bool InDomain(const rocksdb::Slice& key) const override {
+                return _prefixSize(key) > 0;
+            }
+
+            virtual bool InRange(const rocksdb::Slice& dst) const override {
+                return InDomain(dst) && _prefixSize(dst) == dst.size();
+            }
+
+        private:
+            // 0 if the key is not in the domain
+            static size_t _prefixSize(const rocksdb::Slice& key) {
+                if (key.size() <= sizeof(uint32_t)) {
+                    return 0;
+                }
+                const char* end = static_cast<const char*>(
+                    memchr(key.data() + sizeof(uint32_t), kKeyStringEnd,
+                           key.size() - sizeof(uint32_t)));
+                return end == nullptr ? 0 : end - key.data() + 1;
+            }
+
+            static const char kKeyStringEnd = 4;  // KeyString::kEnd
+        };
+
         // ServerParameter to limit concurrency, to prevent thousands of threads running
         // concurrent searches and thus blocking the entire DB.
         class RocksTicketServerParameter : public ServerParameter {
@@ -280,6 +322,17 @@ namespace mongo {
         if (rocksGlobalOptions.counters) {
             _statistics = rocksdb::CreateDBStatistics();
         }
+        if (rocksGlobalOptions.idCacheSize > 0) {
+            _idCache.reset(new RocksIdCache(rocksGlobalOptions.idCacheSize));
+        }
+        if (rocksGlobalOptions.maxMajoritySnapshotAgeSecs > 0) {
+            log() << startupWarningsLog;
+            log() << "** WARNING: rocksdbMaxMajoritySnapshotAgeSecs is set to "
+                  << rocksGlobalOptions.maxMajoritySnapshotAgeSecs << "." << startupWarningsLog;
+            log() << "**          Majority reads fail while the majority commit point lags "
+                  << "by more than that." << startupWarningsLog;
+            log() << startupWarningsLog;
+        }
         _useSeparateOplogCF = rocksGlobalOptions.useSeparateOplogCF;
         _oplogCFIndex = _useSeparateOplogCF ? 1 : 0;
         log() << "useSeparateOplogCF: " << _useSeparateOplogCF << ", oplogCFIndex: " << _oplogCFIndex;
@@ -299,12 +352,18 @@ namespace mongo {
         invariantRocksOK(s);
         _db.reset(db);
 
+        if (!readOnly) {
+            RocksSstBulkLoader::removeLeftovers(_path);
+        }
+
         _counterManager.reset(
             new RocksCounterManager(_db.get(), rocksGlobalOptions.crashSafeCounters));
         _compactionScheduler.reset(new RocksCompactionScheduler(_db.get()));
 
         // open iterator
-        std::unique_ptr<rocksdb::Iterator> iter(_db->NewIterator(rocksdb::ReadOptions()));
+        rocksdb::ReadOptions readOptions;
+        readOptions.total_order_seek = true;
+        std::unique_ptr<rocksdb::Iterator> iter(_db->NewIterator(readOptions));
 
         // find maxPrefix
         iter->SeekToLast();
@@ -470,7 +529,9 @@ namespace mongo {
     RecoveryUnit* RocksEngine::newRecoveryUnit() {
         return new RocksRecoveryUnit(&_transactionEngine, &_snapshotManager, _db.get(),
                                      _counterManager.get(), _compactionScheduler.get(),
-                                     _durabilityManager.get(), _durable);
+                                     _durabilityManager.get(), _durable,
+                                     rocksGlobalOptions.lazyWriteBatchIndex &&
+                                         !_useSeparateOplogCF);
     }
 
     Status RocksEngine::createRecordStore(OperationContext* opCtx, StringData ns, StringData ident,
@@ -566,6 +627,9 @@ namespace mongo {
         BSONObjBuilder configBuilder;
         // let index add its own config things
         RocksIndexBase::generateConfig(&configBuilder, _formatVersion, desc->version());
+        RocksIndexBase::generateStorageConfig(
+            &configBuilder,
+            desc->infoObj().getObjectField("storageEngine").getObjectField("rocksdb"));
         return _createIdent(ident, &configBuilder);
     }
 
@@ -578,9 +642,13 @@ namespace mongo {
 
         RocksIndexBase* index;
         if (desc->unique()) {
-            index = new RocksUniqueIndex(_db.get(), prefix, ident.toString(),
-                                         Ordering::make(desc->keyPattern()), std::move(config),
-                                         desc->parentNS(), desc->indexName(), desc->isPartial());
+            auto ui = new RocksUniqueIndex(_db.get(), prefix, ident.toString(),
+                                           Ordering::make(desc->keyPattern()), std::move(config),
+                                           desc->parentNS(), desc->indexName(), desc->isPartial());
+            if (desc->isIdIndex()) {
+                ui->setIdCache(_idCache.get());
+            }
+            index = ui;
         } else {
             auto si = new RocksStandardIndex(_db.get(), prefix, ident.toString(),
                                              Ordering::make(desc->keyPattern()), std::move(config));
@@ -589,6 +657,9 @@ namespace mongo {
             }
             index = si;
         }
+        index->setCompactionScheduler(_compactionScheduler.get(), desc->parentNS());
+        index->setDropPrefixFunction(
+            [this](const std::string& prefix) { return dropPrefix(prefix); });
         {
             stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
             _identIndexMap[ident] = index;
@@ -610,26 +681,41 @@ namespace mongo {
             prefixesToDrop.push_back(rocksGetNextPrefix(prefixesToDrop[0]));
         }
 
+        auto s = _dropPrefixes(prefixesToDrop, &wb);
+        if (!s.isOK()) {
+            return s;
+        }
+
+        // remove from map
+        {
+            stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
+            _identMap.erase(ident);
+        }
+
+        return Status::OK();
+    }
+
+    Status RocksEngine::dropPrefix(const std::string& prefix) {
+        rocksdb::WriteBatch wb;
+        return _dropPrefixes({prefix}, &wb);
+    }
+
+    Status RocksEngine::_dropPrefixes(const std::vector<std::string>& prefixesToDrop,
+                                      rocksdb::WriteBatch* wb) {
         // We record the fact that we're deleting this prefix. That way we ensure that the prefix is
         // always deleted
         for (const auto& prefix : prefixesToDrop) {
-            wb.Put(kDroppedPrefix + prefix, "");
+            wb->Put(kDroppedPrefix + prefix, "");
         }
 
         // we need to make sure this is on disk before starting to delete data in compactions
         rocksdb::WriteOptions syncOptions;
         syncOptions.sync = true;
-        auto s = _db->Write(syncOptions, &wb);
+        auto s = _db->Write(syncOptions, wb);
         if (!s.ok()) {
             return rocksToMongoStatus(s);
         }
 
-        // remove from map
-        {
-            stdx::lock_guard<stdx::mutex> lk(_identMapMutex);
-            _identMap.erase(ident);
-        }
-
         // instruct compaction filter to start deleting
         {
             stdx::lock_guard<stdx::mutex> lk(_droppedPrefixesMutex);
@@ -733,6 +819,31 @@ namespace mongo {
         _rateLimiter->SetBytesPerSecond(static_cast<int64_t>(_maxWriteMBPerSec) * 1024 * 1024);
     }
 
+    Status RocksEngine::compactCollection(StringData ns) {
+        stdx::lock_guard<stdx::mutex> lk(_identObjectMapMutex);
+        bool found = false;
+        for (const auto& entry : _identCollectionMap) {
+            if (entry.second->ns() == ns) {
+                // the scheduler keeps the task, so it shows up in serverStatus and can be
+                // canceled through rocksdbCancelCompaction
+                auto task = entry.second->scheduleCompaction();
+                log() << "scheduled compaction " << task->id() << " of " << task->description();
+                found = true;
+            }
+        }
+        if (!found) {
+            return Status(ErrorCodes::NamespaceNotFound,
+                          str::stream() << "collection " << ns << " is not open");
+        }
+        for (const auto& entry : _identIndexMap) {
+            if (entry.second->collectionNamespace() == ns) {
+                auto task = entry.second->scheduleCompaction();
+                log() << "scheduled compaction " << task->id() << " of " << task->description();
+            }
+        }
+        return Status::OK();
+    }
+
     Status RocksEngine::backup(const std::string& path) {
         rocksdb::Checkpoint* checkpoint;
         auto s = rocksdb::Checkpoint::Create(_db.get(), &checkpoint);
@@ -802,6 +913,18 @@ namespace mongo {
         table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
         table_options.block_size = 16 * 1024; // 16KB
         table_options.format_version = 2;
+        if (rocksGlobalOptions.dataBlockHashIndex) {
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 16)
+            // Get()s probe the hash index of a data block and only fall back to binary search on
+            // a collision. Iterator seeks still binary search.
+            table_options.format_version = 4;
+            table_options.data_block_index_type =
+                rocksdb::BlockBasedTableOptions::kDataBlockBinaryAndHash;
+            table_options.data_block_hash_table_util_ratio = 0.75;
+#else
+            log() << "dataBlockHashIndex needs RocksDB 5.16 or newer, ignoring it";
+#endif
+        }
         options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
 
         options.write_buffer_size = 64 * 1024 * 1024;  // 64MB
@@ -818,11 +941,33 @@ namespace mongo {
         // keep all RocksDB files opened.
         options.max_open_files = -1;
         options.optimize_filters_for_hits = true;
+        if (rocksGlobalOptions.indexPrefixBloomFilter) {
+            // All collections and indexes share the default column family, so the extractor
+            // (and the bigger filters it brings) applies to every key, not only to the indexes
+            // that asked for prefix bloom filters. Those are the only ones that read with it.
+            options.prefix_extractor.reset(new KeyStringPrefixExtractor());
+            // Lookups that match nothing are what the prefix filters are for, so they need
+            // filters on the last level too
+            options.optimize_filters_for_hits = false;
+#if ROCKSDB_MAJOR >= 5
+            options.memtable_prefix_bloom_size_ratio = 0.05;
+#endif
+        }
         options.compaction_filter_factory.reset(new PrefixDeletingCompactionFilterFactory(this));
         options.enable_thread_tracking = true;
         // Enable concurrent memtable
         options.allow_concurrent_memtable_write = true;
         options.enable_write_thread_adaptive_yield = true;
+        // Concurrent commits are already grouped by RocksDB's write thread: a leader writes the
+        // WAL record for the whole group. With pipelined writes the next group's WAL write
+        // overlaps the previous group's memtable inserts.
+        if (rocksGlobalOptions.pipelinedWrite) {
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 5)
+            options.enable_pipelined_write = true;
+#else
+            log() << "pipelinedWrite needs RocksDB 5.5 or newer, ignoring it";
+#endif
+        }
 
         options.compression_per_level.resize(3);
         options.compression_per_level[0] = rocksdb::kNoCompression;
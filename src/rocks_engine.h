@@ -34,6 +34,7 @@
 #include <string>
 #include <memory>
 #include <unordered_set>
+#include <vector>
 
 #include <boost/optional.hpp>
 
@@ -49,6 +50,7 @@
 
 #include "rocks_compaction_scheduler.h"
 #include "rocks_counter_manager.h"
+#include "rocks_id_cache.h"
 #include "rocks_transaction.h"
 #include "rocks_snapshot_manager.h"
 #include "rocks_durability_manager.h"
@@ -62,6 +64,7 @@ namespace rocksdb {
     class Iterator;
     struct Options;
     struct ReadOptions;
+    class WriteBatch;
 }
 
 namespace mongo {
@@ -142,6 +145,17 @@ namespace mongo {
          */
         static bool initRsOplogBackgroundThread(StringData ns);
 
+        /**
+         * Initializes a background job to remove excess documents in a capped collection with
+         * a maximum document count, so inserts don't have to serialize on the capped deleter.
+         * Only used when storage.rocksdb.cappedMaxDocsSlack is greater than 0. The job serves
+         * the record store with the given ident and exits once that record store is no longer
+         * the collection's, e.g. after a drop. Calling it again for the ident with a new
+         * namespace, as a rename does, moves the job to that namespace. Returns true if a
+         * background job is running for the ident.
+         */
+        static bool initRsCappedBackgroundThread(StringData ns, StringData ident);
+
         virtual void setJournalListener(JournalListener* jl);
 
         // rocks specific api
@@ -152,15 +166,28 @@ namespace mongo {
         std::shared_ptr<rocksdb::Cache> getBlockCache() { return _block_cache; }
         std::unordered_set<uint32_t> getDroppedPrefixes() const;
 
+        // Deletes every key of 'prefix' in compactions, the way dropIdent() deletes an ident's
+        // data, but keeps the ident. Nothing may write to the prefix afterwards.
+        Status dropPrefix(const std::string& prefix);
+
         RocksTransactionEngine* getTransactionEngine() { return &_transactionEngine; }
 
         RocksCompactionScheduler* getCompactionScheduler() const { return _compactionScheduler.get(); }
 
+        RocksDurabilityManager* getDurabilityManager() const { return _durabilityManager.get(); }
+
+        // nullptr if the _id cache is disabled
+        RocksIdCache* getIdCache() const { return _idCache.get(); }
+
         int getMaxWriteMBPerSec() const { return _maxWriteMBPerSec; }
         void setMaxWriteMBPerSec(int maxWriteMBPerSec);
 
         Status backup(const std::string& path);
 
+        // Schedules background compactions of the collection 'ns' and of its indexes, without
+        // waiting for them. Progress is reported in serverStatus.
+        Status compactCollection(StringData ns);
+
         rocksdb::Statistics* getStatistics() const {
           return _statistics.get();
         }
@@ -176,6 +203,9 @@ namespace mongo {
         Status _createIdent(StringData ident, BSONObjBuilder* configBuilder);
         BSONObj _getIdentConfig(StringData ident);
         std::string _extractPrefix(const BSONObj& config);
+        // Writes 'wb' together with markers for 'prefixesToDrop' and starts deleting them
+        Status _dropPrefixes(const std::vector<std::string>& prefixesToDrop,
+                             rocksdb::WriteBatch* wb);
 
         rocksdb::Options _options() const;
 
@@ -221,6 +251,8 @@ namespace mongo {
 
         std::unique_ptr<RocksCompactionScheduler> _compactionScheduler;
 
+        std::unique_ptr<RocksIdCache> _idCache;
+
         static const std::string kMetadataPrefix;
         static const std::string kDroppedPrefix;
         static const std::string kOplogCF;
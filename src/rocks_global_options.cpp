@@ -93,6 +93,97 @@ namespace mongo {
                                "Use separate column-family to store oplogs. "
                                "An optimization.")
             .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.cappedMaxDocsSlack",
+                               "rocksdbCappedMaxDocsSlack", moe::Int,
+                               "Number of documents a capped collection with a 'max' document "
+                               "count may temporarily exceed that count by. When greater than 0, "
+                               "excess documents are removed by a background thread instead of "
+                               "by every insert. Defaults to 0 (exact 'max' enforcement).")
+            .validRange(0, 1000000)
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.validateThreads", "rocksdbValidateThreads",
+                               moe::Int,
+                               "Number of threads validate uses to scan a collection or an "
+                               "index. Each thread scans a range of the data, split at SST "
+                               "file boundaries. Defaults to 1 (serial scan).")
+            .validRange(1, 64)
+            .setDefault(moe::Value(1));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.uniqueIndexRecordIdInKey",
+                               "rocksdbUniqueIndexRecordIdInKey", moe::Bool,
+                               "If true, a new database is created with format version 4, in "
+                               "which new unique indexes store the RecordId in the key, so that "
+                               "inserting into them doesn't read the existing entry. Older "
+                               "versions can't open such a database. Has no effect on existing "
+                               "databases.")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.indexPrefixBloomFilter",
+                               "rocksdbIndexPrefixBloomFilter", moe::Bool,
+                               "If true, bloom filters also cover index keys without their "
+                               "RecordId, so equality lookups on indexes created with "
+                               "{storageEngine: {rocksdb: {prefixBloomFilter: true}}} that "
+                               "match nothing are answered without reading data blocks. The "
+                               "prefixes are added to the filters of all SST files, including "
+                               "those of collections and other indexes, and change the format "
+                               "of newly written SST files.")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.dataBlockHashIndex", "rocksdbDataBlockHashIndex",
+                               moe::Bool,
+                               "If true, data blocks get a hash index next to the binary search "
+                               "index, so point lookups (e.g. fetching a record by RecordId) "
+                               "don't binary search each block. Newly written SST files use "
+                               "table format 4, which RocksDB older than 5.16 can't read.")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.idCacheSize", "rocksdbIdCacheSize", moe::Int,
+                               "Number of _id index lookups to cache in memory, so lookups by "
+                               "_id that hit skip RocksDB. 0 disables the cache.")
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.lazyWriteBatchIndex",
+                               "rocksdbLazyWriteBatchIndex", moe::Bool,
+                               "If true, units of work collect their writes in a plain write "
+                               "batch and only index it when they first read their own writes, "
+                               "which saves the indexing cost of write-only units of work. "
+                               "Ignored when the oplog has its own column family.")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.pipelinedWrite", "rocksdbPipelinedWrite",
+                               moe::Bool,
+                               "If true, RocksDB lets the next group of concurrent commits write "
+                               "the WAL while the previous group is still inserting into the "
+                               "memtable, which raises the throughput of many small concurrent "
+                               "writes. Needs RocksDB 5.5 or newer.")
+            .setDefault(moe::Value(false));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.sharedSnapshotMaxAgeMillis",
+                               "rocksdbSharedSnapshotMaxAgeMillis", moe::Int,
+                               "If positive, reads outside of a unit of work share a snapshot "
+                               "that is at most this many milliseconds old instead of each "
+                               "taking their own. Such reads may miss writes committed by other "
+                               "operations during that time. 0 disables sharing.")
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.maxMajoritySnapshots",
+                               "rocksdbMaxMajoritySnapshots", moe::Int,
+                               "Maximum number of snapshots kept for majority read concern. Past "
+                               "it, snapshots older than the majority commit point are released "
+                               "right away instead of waiting for replication to clean them up. "
+                               "Snapshots that can still become majority committed are always "
+                               "kept. 0 means no limit.")
+            .setDefault(moe::Value(0));
+        rocksOptions
+            .addOptionChaining("storage.rocksdb.maxMajoritySnapshotAgeSecs",
+                               "rocksdbMaxMajoritySnapshotAgeSecs", moe::Int,
+                               "Snapshots kept for majority read concern are released once they "
+                               "are this old, so a lagging majority can't keep old versions "
+                               "around indefinitely. Majority reads fail until a newer snapshot "
+                               "is majority committed. 0 means no limit.")
+            .setDefault(moe::Value(0));
 
         return options->addSection(rocksOptions);
     }
@@ -138,6 +229,62 @@ namespace mongo {
               params["storage.rocksdb.useSeparateOplogCF"].as<bool>();
             log() << "UseSeparateOplogCF: " << rocksGlobalOptions.useSeparateOplogCF;
         }
+        if (params.count("storage.rocksdb.cappedMaxDocsSlack")) {
+            rocksGlobalOptions.cappedMaxDocsSlack =
+                params["storage.rocksdb.cappedMaxDocsSlack"].as<int>();
+            log() << "Capped max docs slack: " << rocksGlobalOptions.cappedMaxDocsSlack;
+        }
+        if (params.count("storage.rocksdb.validateThreads")) {
+            rocksGlobalOptions.validateThreads =
+                params["storage.rocksdb.validateThreads"].as<int>();
+            log() << "Validate threads: " << rocksGlobalOptions.validateThreads;
+        }
+        if (params.count("storage.rocksdb.uniqueIndexRecordIdInKey")) {
+            rocksGlobalOptions.uniqueIndexRecordIdInKey =
+                params["storage.rocksdb.uniqueIndexRecordIdInKey"].as<bool>();
+            log() << "Unique index RecordId in key: "
+                  << rocksGlobalOptions.uniqueIndexRecordIdInKey;
+        }
+        if (params.count("storage.rocksdb.indexPrefixBloomFilter")) {
+            rocksGlobalOptions.indexPrefixBloomFilter =
+                params["storage.rocksdb.indexPrefixBloomFilter"].as<bool>();
+            log() << "Index prefix bloom filter: " << rocksGlobalOptions.indexPrefixBloomFilter;
+        }
+        if (params.count("storage.rocksdb.dataBlockHashIndex")) {
+            rocksGlobalOptions.dataBlockHashIndex =
+                params["storage.rocksdb.dataBlockHashIndex"].as<bool>();
+            log() << "Data block hash index: " << rocksGlobalOptions.dataBlockHashIndex;
+        }
+        if (params.count("storage.rocksdb.idCacheSize")) {
+            rocksGlobalOptions.idCacheSize = params["storage.rocksdb.idCacheSize"].as<int>();
+            log() << "_id cache size: " << rocksGlobalOptions.idCacheSize;
+        }
+        if (params.count("storage.rocksdb.lazyWriteBatchIndex")) {
+            rocksGlobalOptions.lazyWriteBatchIndex =
+                params["storage.rocksdb.lazyWriteBatchIndex"].as<bool>();
+            log() << "Lazy write batch index: " << rocksGlobalOptions.lazyWriteBatchIndex;
+        }
+        if (params.count("storage.rocksdb.pipelinedWrite")) {
+            rocksGlobalOptions.pipelinedWrite = params["storage.rocksdb.pipelinedWrite"].as<bool>();
+            log() << "Pipelined write: " << rocksGlobalOptions.pipelinedWrite;
+        }
+        if (params.count("storage.rocksdb.sharedSnapshotMaxAgeMillis")) {
+            rocksGlobalOptions.sharedSnapshotMaxAgeMillis =
+                params["storage.rocksdb.sharedSnapshotMaxAgeMillis"].as<int>();
+            log() << "Shared snapshot max age (ms): "
+                  << rocksGlobalOptions.sharedSnapshotMaxAgeMillis;
+        }
+        if (params.count("storage.rocksdb.maxMajoritySnapshots")) {
+            rocksGlobalOptions.maxMajoritySnapshots =
+                params["storage.rocksdb.maxMajoritySnapshots"].as<int>();
+            log() << "Max majority snapshots: " << rocksGlobalOptions.maxMajoritySnapshots;
+        }
+        if (params.count("storage.rocksdb.maxMajoritySnapshotAgeSecs")) {
+            rocksGlobalOptions.maxMajoritySnapshotAgeSecs =
+                params["storage.rocksdb.maxMajoritySnapshotAgeSecs"].as<int>();
+            log() << "Max majority snapshot age (s): "
+                  << rocksGlobalOptions.maxMajoritySnapshotAgeSecs;
+        }
 
         return Status::OK();
     }
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "mongo/util/options_parser/startup_option_init.h"
 #include "mongo/util/options_parser/startup_options.h"
 
@@ -42,7 +44,19 @@ namespace mongo {
               maxWriteMBPerSec(1024),
               compression("snappy"),
               crashSafeCounters(false),
-              singleDeleteIndex(false) {}
+              singleDeleteIndex(false),
+              cappedMaxDocsSlack(0),
+              validateThreads(1),
+              uniqueIndexRecordIdInKey(false),
+              indexPrefixBloomFilter(false),
+              dataBlockHashIndex(false),
+              idCacheSize(0),
+              lazyWriteBatchIndex(false),
+              pipelinedWrite(false),
+              sharedSnapshotMaxAgeMillis(0),
+              maxMajoritySnapshots(0),
+              maxMajoritySnapshotAgeSecs(0),
+              validateMode(kValidateModeFull) {}
 
         Status add(moe::OptionSection* options);
         Status store(const moe::Environment& params, const std::vector<std::string>& args);
@@ -57,6 +71,28 @@ namespace mongo {
         bool counters;
         bool singleDeleteIndex;
         bool useSeparateOplogCF;
+        int cappedMaxDocsSlack;
+        int validateThreads;
+        bool uniqueIndexRecordIdInKey;
+        bool indexPrefixBloomFilter;
+        bool dataBlockHashIndex;
+        int idCacheSize;
+        bool lazyWriteBatchIndex;
+        bool pipelinedWrite;
+        int sharedSnapshotMaxAgeMillis;
+        int maxMajoritySnapshots;
+        int maxMajoritySnapshotAgeSecs;
+
+        enum ValidateMode {
+            // scan and decode all data
+            kValidateModeFull,
+            // only verify the block checksums of the SST files
+            kValidateModeChecksum,
+            // both of the above
+            kValidateModeFullAndChecksum,
+        };
+        // changed at runtime through the rocksdbValidateMode server parameter
+        std::atomic<int> validateMode;
     };
 
     extern RocksGlobalOptions rocksGlobalOptions;
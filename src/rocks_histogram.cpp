@@ -0,0 +1,78 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_histogram.h"
+
+#include <string>
+
+#include "mongo/bson/bsonobjbuilder.h"
+
+namespace mongo {
+
+    RocksHistogram::RocksHistogram() : _count(0), _total(0), _max(0) {
+        for (auto& bucket : _buckets) {
+            bucket.store(0);
+        }
+    }
+
+    void RocksHistogram::record(uint64_t value) {
+        int bucket = 0;
+        while (bucket < kNumBuckets - 1 && (value >> bucket) != 0) {
+            ++bucket;
+        }
+        _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _total.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t currentMax = _max.load(std::memory_order_relaxed);
+        while (value > currentMax &&
+               !_max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void RocksHistogram::appendTo(BSONObjBuilder* builder) const {
+        builder->append("count", static_cast<long long>(_count.load()));
+        builder->append("total", static_cast<long long>(_total.load()));
+        builder->append("max", static_cast<long long>(_max.load()));
+
+        BSONObjBuilder bucketsBuilder(builder->subobjStart("buckets"));
+        for (int i = 0; i < kNumBuckets; ++i) {
+            uint64_t count = _buckets[i].load(std::memory_order_relaxed);
+            if (count == 0) {
+                continue;
+            }
+            std::string label = i == kNumBuckets - 1
+                                    ? "inf"
+                                    : "<" + std::to_string(static_cast<uint64_t>(1) << i);
+            bucketsBuilder.append(label, static_cast<long long>(count));
+        }
+        bucketsBuilder.done();
+    }
+}  // namespace mongo
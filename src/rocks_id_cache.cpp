@@ -0,0 +1,164 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_id_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "mongo/bson/bsonobjbuilder.h"
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    RocksIdCache::RocksIdCache(size_t capacity)
+        : _shardCapacity(std::max(capacity / kNumShards, static_cast<size_t>(1))),
+          _shards(kNumShards),
+          _hits(0),
+          _misses(0) {}
+
+    bool RocksIdCache::lookup(const std::string& key, uint64_t snapshotSequenceNumber,
+                              std::string* foundKey, std::string* value) {
+        auto& shard = _shard(key);
+        {
+            stdx::lock_guard<stdx::mutex> lk(shard.lock);
+            auto iter = shard.entries.find(key);
+            // an older snapshot might not see the cached entry yet
+            if (iter != shard.entries.end() && iter->second.cached &&
+                iter->second.writesInFlight == 0 &&
+                iter->second.sequenceNumber <= snapshotSequenceNumber) {
+                Entry& entry = iter->second;
+                shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruPosition);
+                *foundKey = entry.foundKey;
+                *value = entry.value;
+                _hits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void RocksIdCache::insert(const std::string& key, uint64_t snapshotSequenceNumber,
+                              const std::string& foundKey, const std::string& value) {
+        auto& shard = _shard(key);
+        stdx::lock_guard<stdx::mutex> lk(shard.lock);
+        if (snapshotSequenceNumber < shard.minSequenceNumber) {
+            // the snapshot might miss a write to the key that's no longer tracked
+            return;
+        }
+        auto iter = shard.entries.find(key);
+        if (iter != shard.entries.end() &&
+            (iter->second.writesInFlight > 0 ||
+             snapshotSequenceNumber < iter->second.minSequenceNumber)) {
+            // the snapshot might miss a write to the key
+            return;
+        }
+        Entry& entry = _touch_inlock(shard, key);
+        entry.cached = true;
+        entry.sequenceNumber = snapshotSequenceNumber;
+        entry.foundKey = foundKey;
+        entry.value = value;
+        _evict_inlock(shard);
+    }
+
+    void RocksIdCache::beginWrite(const std::string& key) {
+        auto& shard = _shard(key);
+        stdx::lock_guard<stdx::mutex> lk(shard.lock);
+        ++_touch_inlock(shard, key).writesInFlight;
+    }
+
+    void RocksIdCache::endWrite(const std::string& key, uint64_t latestSequenceNumber) {
+        auto& shard = _shard(key);
+        stdx::lock_guard<stdx::mutex> lk(shard.lock);
+        auto iter = shard.entries.find(key);
+        // entries with writes in flight aren't evicted
+        invariant(iter != shard.entries.end());
+        Entry& entry = iter->second;
+        invariant(entry.writesInFlight > 0);
+        --entry.writesInFlight;
+        if (latestSequenceNumber > 0) {
+            entry.cached = false;
+            entry.foundKey.clear();
+            entry.value.clear();
+            entry.minSequenceNumber = std::max(entry.minSequenceNumber, latestSequenceNumber);
+        } else if (!entry.cached && entry.writesInFlight == 0 && entry.minSequenceNumber == 0) {
+            // a rolled back write to a key we know nothing else about
+            shard.lru.erase(entry.lruPosition);
+            shard.entries.erase(iter);
+            return;
+        }
+        _evict_inlock(shard);
+    }
+
+    void RocksIdCache::appendStats(BSONObjBuilder* builder) const {
+        long long numEntries = 0;
+        for (auto& shard : _shards) {
+            stdx::lock_guard<stdx::mutex> lk(shard.lock);
+            numEntries += shard.entries.size();
+        }
+        builder->append("entries", numEntries);
+        builder->append("hits", _hits.load(std::memory_order_relaxed));
+        builder->append("misses", _misses.load(std::memory_order_relaxed));
+    }
+
+    RocksIdCache::Shard& RocksIdCache::_shard(const std::string& key) {
+        return _shards[std::hash<std::string>()(key) % kNumShards];
+    }
+
+    RocksIdCache::Entry& RocksIdCache::_touch_inlock(Shard& shard, const std::string& key) {
+        auto result = shard.entries.emplace(key, Entry());
+        Entry& entry = result.first->second;
+        if (result.second) {
+            // keys of unordered_map nodes don't move
+            shard.lru.push_front(&result.first->first);
+            entry.lruPosition = shard.lru.begin();
+        } else {
+            shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruPosition);
+        }
+        return entry;
+    }
+
+    void RocksIdCache::_evict_inlock(Shard& shard) {
+        auto position = shard.lru.end();
+        while (shard.entries.size() > _shardCapacity && position != shard.lru.begin()) {
+            --position;
+            auto iter = shard.entries.find(**position);
+            invariant(iter != shard.entries.end());
+            if (iter->second.writesInFlight > 0) {
+                continue;
+            }
+            shard.minSequenceNumber =
+                std::max(shard.minSequenceNumber, iter->second.minSequenceNumber);
+            position = shard.lru.erase(position);
+            shard.entries.erase(iter);
+        }
+    }
+}  // namespace mongo
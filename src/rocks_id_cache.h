@@ -0,0 +1,113 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mongo/stdx/mutex.h"
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * A bounded, sharded LRU cache of _id index lookups: from the prefixed index key to what a
+     * seekExact() found, the stored key and its value. All methods are thread-safe.
+     *
+     * Entries are versioned by RocksDB sequence numbers. An entry read from a snapshot at sequence
+     * S is only served to snapshots at or after S, and only as long as no write to its key is in
+     * flight. Every write to a key brackets its unit of work with beginWrite() and endWrite(),
+     * which drops the cached lookup and refuses lookups read from snapshots older than the write.
+     * Keys with writes in flight are never evicted. When a key's write history is evicted, the
+     * shard refuses lookups from snapshots older than that history instead.
+     */
+    class RocksIdCache {
+    public:
+        explicit RocksIdCache(size_t capacity);
+
+        // Returns true and fills foundKey and value on a hit
+        bool lookup(const std::string& key, uint64_t snapshotSequenceNumber, std::string* foundKey,
+                    std::string* value);
+
+        // Remembers what a lookup in a snapshot at snapshotSequenceNumber found
+        void insert(const std::string& key, uint64_t snapshotSequenceNumber,
+                    const std::string& foundKey, const std::string& value);
+
+        void beginWrite(const std::string& key);
+        // latestSequenceNumber is a sequence number at or after the commit, 0 on rollback
+        void endWrite(const std::string& key, uint64_t latestSequenceNumber);
+
+        void appendStats(BSONObjBuilder* builder) const;
+
+    private:
+        static const size_t kNumShards = 64;
+
+        struct Entry {
+            // false if only the key's writes are tracked
+            bool cached = false;
+            uint64_t sequenceNumber = 0;
+            std::string foundKey;
+            std::string value;
+            // number of units of work with an uncommitted write to the key
+            int writesInFlight = 0;
+            // lookups read before this are stale
+            uint64_t minSequenceNumber = 0;
+            // position in Shard::lru
+            std::list<const std::string*>::iterator lruPosition;
+        };
+
+        struct Shard {
+            mutable stdx::mutex lock;
+            std::unordered_map<std::string, Entry> entries;
+            // keys of entries, most recently used first
+            std::list<const std::string*> lru;
+            // lookups read before this might be stale, from the write history of evicted keys
+            uint64_t minSequenceNumber = 0;
+        };
+
+        Shard& _shard(const std::string& key);
+
+        // Returns the key's entry, created if needed, and marks it as most recently used
+        static Entry& _touch_inlock(Shard& shard, const std::string& key);
+
+        // Evicts least recently used entries without writes in flight down to the capacity
+        void _evict_inlock(Shard& shard);
+
+        const size_t _shardCapacity;
+        std::vector<Shard> _shards;
+
+        std::atomic<long long> _hits;
+        std::atomic<long long> _misses;
+    };
+}  // namespace mongo
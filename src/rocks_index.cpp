@@ -32,7 +32,9 @@
 
 #include "rocks_index.h"
 
+#include <atomic>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -50,10 +52,15 @@
 #include "mongo/util/log.h"
 #include "mongo/util/mongoutils/str.h"
 
+#include "rocks_compaction_scheduler.h"
 #include "rocks_engine.h"
+#include "rocks_global_options.h"
+#include "rocks_id_cache.h"
 #include "rocks_record_store.h"
 #include "rocks_recovery_unit.h"
+#include "rocks_sst_bulk_loader.h"
 #include "rocks_util.h"
+#include "rocks_validate.h"
 
 namespace mongo {
 
@@ -64,8 +71,10 @@ namespace mongo {
     namespace {
         static const int kKeyStringV0Version = 0;
         static const int kKeyStringV1Version = 1;
+        // unique indexes store <key><RecordId> -> TypeBits, like standard indexes
+        static const int kUniqueKeyWithRecordIdVersion = 2;
         static const int kMinimumIndexVersion = kKeyStringV0Version;
-        static const int kMaximumIndexVersion = kKeyStringV1Version;
+        static const int kMaximumIndexVersion = kUniqueKeyWithRecordIdVersion;
 
         /**
          * Strips the field names from a BSON object
@@ -108,10 +117,12 @@ namespace mongo {
         class RocksCursorBase : public SortedDataInterface::Cursor {
         public:
             RocksCursorBase(OperationContext* opCtx, rocksdb::DB* db, std::string prefix,
-                            bool forward, Ordering order, KeyString::Version keyStringVersion)
+                            bool forward, Ordering order, KeyString::Version keyStringVersion,
+                            bool prefixBloomFilter = false)
                 : _db(db),
                   _prefix(prefix),
                   _forward(forward),
+                  _prefixBloomFilter(prefixBloomFilter),
                   _order(order),
                   _keyStringVersion(keyStringVersion),
                   _key(keyStringVersion),
@@ -135,9 +146,17 @@ namespace mongo {
             }
 
             void setEndPosition(const BSONObj& key, bool inclusive) override {
+                if (_iteratorIsPrefixSeek) {
+                    // it can't leave the current key's prefix. advanceCursor() repositions a new
+                    // iterator if needed
+                    _iterator.reset();
+                    _iteratorIsPrefixSeek = false;
+                }
                 if (key.isEmpty()) {
                     // This means scan to end of index.
                     _endPosition.reset();
+                    _endKey = BSONObj();
+                    setIteratorBounds();
                     return;
                 }
 
@@ -145,14 +164,27 @@ namespace mongo {
                 // end after the key if inclusive and before if exclusive.
                 const auto discriminator = _forward == inclusive ? KeyString::kExclusiveAfter
                                                                  : KeyString::kExclusiveBefore;
+                _endKey = stripFieldNames(key);
+                _endInclusive = inclusive;
                 _endPosition = stdx::make_unique<KeyString>(_keyStringVersion);
-                _endPosition->resetToKey(stripFieldNames(key), _order, discriminator);
+                _endPosition->resetToKey(_endKey, _order, discriminator);
+                setIteratorBounds();
             }
 
             boost::optional<IndexKeyEntry> seek(const BSONObj& key, bool inclusive,
                                                 RequestedInfo parts) override {
                 const BSONObj finalKey = stripFieldNames(key);
 
+                if (_prefixBloomFilter && _forward && inclusive && _endPosition &&
+                    _endInclusive && finalKey.binaryEqual(_endKey)) {
+                    // An equality range: all entries share the prefix of the key without
+                    // discriminator, which lets a prefix seek skip files that don't have it
+                    _query.resetToKey(finalKey, _order);
+                    seekCursor(_query, true);
+                    updatePosition();
+                    return curr(parts);
+                }
+
                 const auto discriminator = _forward == inclusive ? KeyString::kExclusiveBefore
                     : KeyString::kExclusiveAfter;
 
@@ -193,7 +225,7 @@ namespace mongo {
                 auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx);
                 if (!_iterator.get() ||
                     _currentSequenceNumber != ru->snapshot()->GetSequenceNumber()) {
-                    _iterator.reset(ru->NewIterator(_prefix));
+                    newIterator(false);
                     _currentSequenceNumber = ru->snapshot()->GetSequenceNumber();
 
                     if (!_savedEOF) {
@@ -212,30 +244,119 @@ namespace mongo {
                 // iterator recreated in restore()
             }
 
+            void setIdCache(RocksIdCache* idCache) { _idCache = idCache; }
+
         protected:
-            // Called after _key has been filled in. Must not throw WriteConflictException.
+            // Positions the cursor on what the _id cache has for the key in _query, like a
+            // seekExact() that found it. Returns false on a miss.
+            bool seekExactFromIdCache() {
+                if (!_idCache) {
+                    return false;
+                }
+                std::string foundKey;
+                if (!_idCache->lookup(_idCacheKey(), _snapshotSequenceNumber(), &foundKey,
+                                      &_value)) {
+                    return false;
+                }
+                _eof = false;
+                _iterator.reset();
+                _query.resetFromBuffer(foundKey.data(), foundKey.size());
+                updatePosition();
+                return true;
+            }
+
+            // Remembers what a seekExact() for the key in cacheKey found
+            void cacheSeekExactResult(const std::string& cacheKey, const rocksdb::Slice& foundKey,
+                                      const rocksdb::Slice& value) {
+                if (_idCache && !_eof) {
+                    _idCache->insert(cacheKey, _snapshotSequenceNumber(), foundKey.ToString(),
+                                     value.ToString());
+                }
+            }
+
+            std::string _idCacheKey() const {
+                std::string key(_prefix);
+                key.append(_query.getBuffer(), _query.getSize());
+                return key;
+            }
+
+            uint64_t _snapshotSequenceNumber() const {
+                return RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx)->snapshot()
+                    ->GetSequenceNumber();
+            }
+
+            // Decodes _loc and _typeBits from _key and the current value. Called at most once per
+            // position, and only if the caller asked for the key or the RecordId. Must not throw
+            // WriteConflictException.
             virtual void updateLocAndTypeBits() = 0;
 
-            boost::optional<IndexKeyEntry> curr(RequestedInfo parts) const {
+            // Size of the part of an encoded entry key that encodes the index key, without the
+            // RecordId
+            virtual size_t keySizeWithoutRecordId(const char* key, size_t size) const = 0;
+
+            boost::optional<IndexKeyEntry> curr(RequestedInfo parts) {
                 if (_eof) {
                     return {};
                 }
 
+                if (parts == kJustExistance) {
+                    // existence checks and counts don't look at the entry
+                    return {{BSONObj(), RecordId()}};
+                }
+
+                if (!_locAndTypeBitsDecoded) {
+                    _locAndTypeBitsDecoded = true;
+                    updateLocAndTypeBits();
+                }
+
                 BSONObj bson;
                 if (parts & kWantKey) {
-                    bson =  KeyString::toBson(_key.getBuffer(), _key.getSize(), _order, _typeBits);
+                    bson = decodeKey();
                 }
 
                 return {{std::move(bson), _loc}};
             }
 
+            // Consecutive entries often share the index key (standard indexes on low cardinality
+            // fields, or the same position returned again), so we keep the last decoded key
+            // until the key bytes or TypeBits change. Changes are detected when _key and
+            // _typeBits are overwritten, so nothing needs to be copied for this.
+            BSONObj decodeKey() {
+                if (!_decodedKeyValid) {
+                    _decodedKey = KeyString::toBson(
+                        _key.getBuffer(), keySizeWithoutRecordId(_key.getBuffer(), _key.getSize()),
+                        _order, _typeBits);
+                    _decodedKeyValid = true;
+                }
+                return _decodedKey;
+            }
+
+            void resetKey(const char* key, size_t size) {
+                if (_decodedKeyValid) {
+                    const size_t keySize = keySizeWithoutRecordId(key, size);
+                    _decodedKeyValid =
+                        keySize == keySizeWithoutRecordId(_key.getBuffer(), _key.getSize()) &&
+                        memcmp(key, _key.getBuffer(), keySize) == 0;
+                }
+                _key.resetFromBuffer(key, size);
+            }
+
+            void resetTypeBits(BufReader* br) {
+                KeyString::TypeBits typeBits =
+                    KeyString::TypeBits::fromBuffer(_keyStringVersion, br);
+                if (_decodedKeyValid) {
+                    _decodedKeyValid = typeBits.getSize() == _typeBits.getSize() &&
+                        memcmp(typeBits.getBuffer(), _typeBits.getBuffer(), typeBits.getSize()) == 0;
+                }
+                _typeBits = typeBits;
+            }
+
             void advanceCursor() {
                 if (_eof) {
                     return;
                 }
                 if (_iterator.get() == nullptr) {
-                    _iterator.reset(RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx)
-                            ->NewIterator(_prefix));
+                    newIterator(false);
                     _iterator->SeekPrefix(rocksdb::Slice(_key.getBuffer(), _key.getSize()));
                     // advanceCursor() should only ever be called in states where the above seek
                     // will succeed in finding the exact key
@@ -249,35 +370,22 @@ namespace mongo {
                 _updateOnIteratorValidity();
             }
 
-            // Seeks to query. Returns true on exact match.
-            bool seekCursor(const KeyString& query) {
-                auto * iter = iterator();
+            // Seeks to query. Returns true on exact match. A prefix seek only finds keys that
+            // share query's prefix bloom prefix, see RocksRecoveryUnit::NewPrefixSeekIterator().
+            bool seekCursor(const KeyString& query, bool prefixSeek = false) {
+                auto * iter = iterator(prefixSeek);
                 const rocksdb::Slice keySlice(query.getBuffer(), query.getSize());
-                iter->Seek(keySlice);
+                if (_forward) {
+                    iter->Seek(keySlice);
+                } else {
+                    // lands on the last key <= query, which is where a reverse scan starts
+                    iter->SeekForPrev(keySlice);
+                }
                 if (!_updateOnIteratorValidity()) {
-                    if (!_forward) {
-                        // this will give lower bound behavior for backwards
-                        iter->SeekToLast();
-                        _updateOnIteratorValidity();
-                    }
                     return false;
                 }
 
-                if (iter->key() == keySlice) {
-                    return true;
-                }
-
-                if (!_forward) {
-                    // if we can't find the exact result going backwards, we
-                    // need to call Prev() so that we're at the first value
-                    // less than (to the left of) what we were searching for,
-                    // rather than the first value greater than (to the right
-                    // of) the value we were searching for.
-                    iter->Prev();
-                    _updateOnIteratorValidity();
-                }
-
-                return false;
+                return iter->key() == keySlice;
             }
 
             void updatePosition() {
@@ -289,10 +397,10 @@ namespace mongo {
 
                 if (_iterator.get() == nullptr) {
                     // _iterator is out of position because we just did a seekExact
-                    _key.resetFromBuffer(_query.getBuffer(), _query.getSize());
+                    resetKey(_query.getBuffer(), _query.getSize());
                 } else {
                     auto key = _iterator->key();
-                    _key.resetFromBuffer(key.data(), key.size());
+                    resetKey(key.data(), key.size());
                 }
 
                 if (_endPosition) {
@@ -303,18 +411,43 @@ namespace mongo {
                     }
                 }
 
-                updateLocAndTypeBits();
+                // decoded on demand by curr()
+                _locAndTypeBitsDecoded = false;
             }
 
-            // ensure that _iterator is initialized and return a pointer to it
-            RocksIterator * iterator() {
-                if (_iterator.get() == nullptr) {
-                    _iterator.reset(RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx)
-                            ->NewIterator(_prefix));
+            // ensure that _iterator is initialized in the right mode and return a pointer to it
+            RocksIterator * iterator(bool prefixSeek = false) {
+                if (_iterator.get() == nullptr || _iteratorIsPrefixSeek != prefixSeek) {
+                    newIterator(prefixSeek);
                 }
                 return _iterator.get();
             }
 
+            void newIterator(bool prefixSeek) {
+                auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx);
+                _iterator.reset(prefixSeek ? ru->NewPrefixSeekIterator(_prefix)
+                                           : ru->NewIterator(_prefix));
+                _iteratorIsPrefixSeek = prefixSeek;
+                setIteratorBounds();
+            }
+
+            // Lets RocksDB stop at the end position instead of reading past it. updatePosition()
+            // still checks _endPosition since the bounds don't apply to the write batch.
+            void setIteratorBounds() {
+                if (_iterator.get() == nullptr) {
+                    return;
+                }
+                rocksdb::Slice end;
+                if (_endPosition) {
+                    end = rocksdb::Slice(_endPosition->getBuffer(), _endPosition->getSize());
+                }
+                if (_forward) {
+                    _iterator->setBounds(rocksdb::Slice(), end);
+                } else {
+                    _iterator->setBounds(end, rocksdb::Slice());
+                }
+            }
+
             // Update _eof based on _iterator->Valid() and return _iterator->Valid()
             bool _updateOnIteratorValidity() {
                 if (_iterator->Valid()) {
@@ -337,7 +470,10 @@ namespace mongo {
             rocksdb::DB* _db;                                       // not owned
             std::string _prefix;
             std::unique_ptr<RocksIterator> _iterator;
+            bool _iteratorIsPrefixSeek = false;
             const bool _forward;
+            // true if lookups of a single key may use prefix bloom filters
+            const bool _prefixBloomFilter;
             bool _lastMoveWasRestore = false;
             Ordering _order;
 
@@ -354,26 +490,102 @@ namespace mongo {
             KeyString _query;
 
             std::unique_ptr<KeyString> _endPosition;
+            // the key _endPosition was built from
+            BSONObj _endKey;
+            bool _endInclusive = false;
 
             bool _eof = false;
             OperationContext* _opCtx;
 
             // stores the value associated with the latest call to seekExact()
             std::string _value;
+
+            bool _locAndTypeBitsDecoded = false;
+
+            // the key last returned by decodeKey(), valid while _key and _typeBits still decode
+            // to it
+            BSONObj _decodedKey;
+            bool _decodedKeyValid = false;
+
+            RocksIdCache* _idCache = nullptr;  // not owned
         };
 
         class RocksStandardCursor final : public RocksCursorBase {
         public:
             RocksStandardCursor(OperationContext* opCtx, rocksdb::DB* db, std::string prefix,
-                                bool forward, Ordering order, KeyString::Version keyStringVersion)
-                : RocksCursorBase(opCtx, db, prefix, forward, order, keyStringVersion) {
+                                bool forward, Ordering order, KeyString::Version keyStringVersion,
+                                bool prefixBloomFilter = false)
+                : RocksCursorBase(opCtx, db, prefix, forward, order, keyStringVersion,
+                                  prefixBloomFilter) {
                 iterator();
             }
 
+            boost::optional<IndexKeyEntry> seekExact(const BSONObj& key,
+                                                     RequestedInfo parts) override {
+                if (!_idCache) {
+                    return _seekExact(key, parts);
+                }
+                // only set for the _id index in the <key><RecordId> format
+                _query.resetToKey(stripFieldNames(key), _order);
+                const std::string cacheKey = _idCacheKey();
+                if (seekExactFromIdCache()) {
+                    return curr(parts);
+                }
+                auto entry = _seekExact(key, parts);
+                // a miss may have left the iterator on the next key, so only hits are cached
+                if (entry && _iterator.get() == nullptr) {
+                    cacheSeekExactResult(cacheKey,
+                                         rocksdb::Slice(_query.getBuffer(), _query.getSize()),
+                                         _value);
+                } else if (entry) {
+                    cacheSeekExactResult(cacheKey, _iterator->key(), _iterator->value());
+                }
+                return entry;
+            }
+
             virtual void updateLocAndTypeBits() {
                 _loc = KeyString::decodeRecordIdAtEnd(_key.getBuffer(), _key.getSize());
                 BufReader br(_valueSlice().data(), _valueSlice().size());
-                _typeBits.resetFromBuffer(&br);
+                resetTypeBits(&br);
+            }
+
+            virtual size_t keySizeWithoutRecordId(const char* key, size_t size) const {
+                // The last byte of an encoded RecordId holds the number of bytes it has after the
+                // first two in its low 3 bits, like KeyString::decodeRecordIdAtEnd() reads it
+                invariant(size >= 2);
+                const size_t recordIdSize =
+                    2 + (static_cast<unsigned char>(key[size - 1]) & 0x7);
+                invariant(size >= recordIdSize);
+                return size - recordIdSize;
+            }
+
+        private:
+            boost::optional<IndexKeyEntry> _seekExact(const BSONObj& key, RequestedInfo parts) {
+                if (!_prefixBloomFilter || !_forward) {
+                    return RocksCursorBase::seekExact(key, parts);
+                }
+
+                // Probe with a prefix seek iterator, which answers most misses from the bloom
+                // filters. On a hit the cursor is left like after RocksUniqueCursor::seekExact():
+                // without an iterator, which advanceCursor() recreates if needed.
+                _eof = false;
+                _iterator.reset();
+
+                _query.resetToKey(stripFieldNames(key), _order);
+                const rocksdb::Slice keySlice(_query.getBuffer(), _query.getSize());
+                std::unique_ptr<RocksIterator> probe(
+                    RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx)->NewPrefixSeekIterator(
+                        _prefix));
+                probe->Seek(keySlice);
+                if (probe->Valid() && probe->key().starts_with(keySlice)) {
+                    _value.assign(probe->value().data(), probe->value().size());
+                    _query.resetFromBuffer(probe->key().data(), probe->key().size());
+                } else {
+                    invariantRocksOK(probe->status());
+                    _eof = true;
+                }
+                updatePosition();
+                return curr(parts);
             }
         };
 
@@ -388,9 +600,11 @@ namespace mongo {
                 _eof = false;
                 _iterator.reset();
 
-                std::string prefixedKey(_prefix);
                 _query.resetToKey(stripFieldNames(key), _order);
-                prefixedKey.append(_query.getBuffer(), _query.getSize());
+                std::string prefixedKey(_idCacheKey());
+                if (seekExactFromIdCache()) {
+                    return curr(parts);
+                }
                 rocksdb::Status status = RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx)
                     ->Get(prefixedKey, &_value);
 
@@ -400,6 +614,8 @@ namespace mongo {
                     invariantRocksOK(status);
                 }
                 updatePosition();
+                cacheSeekExactResult(prefixedKey,
+                                     rocksdb::Slice(_query.getBuffer(), _query.getSize()), _value);
                 return curr(parts);
             }
 
@@ -410,7 +626,7 @@ namespace mongo {
                 // sufficient locks to ensure that no cursor ever sees them.
                 BufReader br(_valueSlice().data(), _valueSlice().size());
                 _loc = KeyString::decodeRecordId(&br);
-                _typeBits.resetFromBuffer(&br);
+                resetTypeBits(&br);
 
                 if (!br.atEof()) {
                     severe() << "Unique index cursor seeing multiple records for key "
@@ -418,6 +634,57 @@ namespace mongo {
                     fassertFailed(28609);
                 }
             }
+
+            size_t keySizeWithoutRecordId(const char* key, size_t size) const {
+                return size;
+            }
+        };
+
+        // Bulk loaded keys are ingested as SST files, so they don't go through the write batch
+        // and a rollback of the unit of work wouldn't remove them. This drops them through the
+        // engine's dropped prefix path instead, which keeps deleting them after a crash, too. A
+        // rolled back bulk load fails the index build and its ident gets dropped, so nothing
+        // writes to the prefix again.
+        class BulkIngestChange : public RecoveryUnit::Change {
+        public:
+            BulkIngestChange(const RocksIndexBase::DropPrefixFunction& dropPrefix,
+                             std::string prefix, std::atomic<long long>* storageSize,
+                             long long storageBytes)
+                : _dropPrefix(dropPrefix),
+                  _prefix(std::move(prefix)),
+                  _storageSize(storageSize),
+                  _storageBytes(storageBytes) {}
+
+            virtual void commit() {}
+            virtual void rollback() {
+                Status s = _dropPrefix(_prefix);
+                if (!s.isOK()) {
+                    // the keys stay until the build's ident is dropped
+                    warning() << "failed to drop bulk loaded keys: " << s;
+                }
+                _storageSize->fetch_sub(_storageBytes, std::memory_order_relaxed);
+            }
+
+        private:
+            const RocksIndexBase::DropPrefixFunction& _dropPrefix;  // owned by the index
+            const std::string _prefix;
+            std::atomic<long long>* _storageSize;  // not owned
+            const long long _storageBytes;
+        };
+
+        // Ends a write to a key of the _id index with the unit of work
+        class IdCacheWriteChange : public RecoveryUnit::Change {
+        public:
+            IdCacheWriteChange(RocksIdCache* idCache, rocksdb::DB* db, std::string key)
+                : _idCache(idCache), _db(db), _key(std::move(key)) {}
+
+            virtual void commit() { _idCache->endWrite(_key, _db->GetLatestSequenceNumber()); }
+            virtual void rollback() { _idCache->endWrite(_key, 0); }
+
+        private:
+            RocksIdCache* _idCache;  // not owned
+            rocksdb::DB* _db;        // not owned
+            const std::string _key;
         };
 
     } // namespace
@@ -427,21 +694,51 @@ namespace mongo {
      */
     class RocksIndexBase::StandardBulkBuilder : public SortedDataBuilderInterface {
     public:
-        StandardBulkBuilder(RocksStandardIndex* index, OperationContext* opCtx) : _index(index),
-                                                                                  _opCtx(opCtx) {}
+        StandardBulkBuilder(RocksStandardIndex* index, OperationContext* opCtx)
+            : _index(index), _opCtx(opCtx) {
+            if (index->_canIngestBulkLoad()) {
+                _loader.reset(new RocksSstBulkLoader(index->_db, index->_ident));
+            }
+        }
 
         Status addKey(const BSONObj& key, const RecordId& loc) {
-            return _index->insert(_opCtx, key, loc, true);
+            if (!_loader) {
+                return _index->insert(_opCtx, key, loc, true);
+            }
+
+            Status s = checkKeySize(key);
+            if (!s.isOK()) {
+                return s;
+            }
+
+            KeyString encodedKey(_index->_keyStringVersion, key, _index->_order, loc);
+            std::string prefixedKey(_makePrefixedKey(_index->_prefix, encodedKey));
+            rocksdb::Slice value;
+            if (!encodedKey.getTypeBits().isAllZeros()) {
+                value =
+                    rocksdb::Slice(reinterpret_cast<const char*>(encodedKey.getTypeBits().getBuffer()),
+                                   encodedKey.getTypeBits().getSize());
+            }
+
+            _loadedBytes += static_cast<long long>(prefixedKey.size());
+            return _loader->add(prefixedKey, value);
         }
 
         void commit(bool mayInterrupt) {
             WriteUnitOfWork uow(_opCtx);
+            if (_loader) {
+                _index->_ingestBulkLoad(_opCtx, _loader.get(), _loadedBytes);
+            }
             uow.commit();
         }
 
     private:
         RocksStandardIndex* _index;
         OperationContext* _opCtx;
+        // nullptr if the keys go through the write batch
+        std::unique_ptr<RocksSstBulkLoader> _loader;
+        // what the loaded keys add to the index's storage size once they're ingested
+        long long _loadedBytes = 0;
     };
 
     /**
@@ -451,20 +748,27 @@ namespace mongo {
      * after it sees a key after the one we are trying to insert. This allows us to gather up all
      * duplicate locs and insert them all together. This is necessary since bulk cursors can only
      * append data.
+     *
+     * Indexes that keep the RecordId in the key don't need that: every record gets its own entry.
      */
     class RocksIndexBase::UniqueBulkBuilder : public SortedDataBuilderInterface {
     public:
-        UniqueBulkBuilder(std::string prefix, Ordering ordering,
+        UniqueBulkBuilder(RocksIndexBase* index, std::string prefix, Ordering ordering,
                           KeyString::Version keyStringVersion, std::string collectionNamespace,
-                          std::string indexName, OperationContext* opCtx,
-                          bool dupsAllowed)
-            : _prefix(std::move(prefix)),
+                          std::string indexName, OperationContext* opCtx, bool dupsAllowed,
+                          bool keyWithRecordId)
+            : _index(index),
+              _loader(index->_canIngestBulkLoad()
+                          ? new RocksSstBulkLoader(index->_db, index->_ident)
+                          : nullptr),
+              _prefix(std::move(prefix)),
               _ordering(ordering),
               _keyStringVersion(keyStringVersion),
               _collectionNamespace(std::move(collectionNamespace)),
               _indexName(std::move(indexName)),
               _opCtx(opCtx),
               _dupsAllowed(dupsAllowed),
+              _keyWithRecordId(keyWithRecordId),
               _keyString(keyStringVersion) {}
 
         Status addKey(const BSONObj& newKey, const RecordId& loc) {
@@ -494,6 +798,11 @@ namespace mongo {
             }
 
             _key = newKey.getOwned();
+            if (_keyWithRecordId) {
+                _keyString.resetToKey(_key, _ordering, loc);
+                doInsertWithRecordId();
+                return Status::OK();
+            }
             _keyString.resetToKey(_key, _ordering);
             _records.push_back(std::make_pair(loc, _keyString.getTypeBits()));
 
@@ -506,10 +815,37 @@ namespace mongo {
                 // This handles inserting the last unique key.
                 doInsert();
             }
+            if (_loader) {
+                _index->_ingestBulkLoad(_opCtx, _loader.get(), _loadedBytes);
+            }
             uow.commit();
         }
 
     private:
+        void put(const std::string& prefixedKey, const rocksdb::Slice& value) {
+            if (_loader) {
+                uassertStatusOK(_loader->add(prefixedKey, value));
+                _loadedBytes += static_cast<long long>(prefixedKey.size());
+            } else {
+                auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx);
+                ru->writeBatch()->Put(prefixedKey, value);
+                _index->_indexStorageSize.fetch_add(static_cast<long long>(prefixedKey.size()),
+                                                    std::memory_order_relaxed);
+            }
+        }
+
+        void doInsertWithRecordId() {
+            std::string prefixedKey(RocksIndexBase::_makePrefixedKey(_prefix, _keyString));
+            rocksdb::Slice value;
+            if (!_keyString.getTypeBits().isAllZeros()) {
+                value =
+                    rocksdb::Slice(reinterpret_cast<const char*>(_keyString.getTypeBits().getBuffer()),
+                                   _keyString.getTypeBits().getSize());
+            }
+
+            put(prefixedKey, value);
+        }
+
         void doInsert() {
             invariant(!_records.empty());
 
@@ -526,12 +862,16 @@ namespace mongo {
             std::string prefixedKey(RocksIndexBase::_makePrefixedKey(_prefix, _keyString));
             rocksdb::Slice valueSlice(value.getBuffer(), value.getSize());
 
-            auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(_opCtx);
-            ru->writeBatch()->Put(prefixedKey, valueSlice);
+            put(prefixedKey, valueSlice);
 
             _records.clear();
         }
 
+        RocksIndexBase* _index;
+        // nullptr if the keys go through the write batch
+        std::unique_ptr<RocksSstBulkLoader> _loader;
+        // what the loaded keys add to the index's storage size once they're ingested
+        long long _loadedBytes = 0;
         std::string _prefix;
         Ordering _ordering;
         const KeyString::Version _keyStringVersion;
@@ -539,6 +879,7 @@ namespace mongo {
         std::string _indexName;
         OperationContext* _opCtx;
         const bool _dupsAllowed;
+        const bool _keyWithRecordId;
         BSONObj _key;
         KeyString _keyString;
         std::vector<std::pair<RecordId, KeyString::TypeBits>> _records;
@@ -549,6 +890,7 @@ namespace mongo {
     RocksIndexBase::RocksIndexBase(rocksdb::DB* db, std::string prefix, std::string ident,
                                    Ordering order, const BSONObj& config)
         : _db(db),
+          _compactionScheduler(nullptr),
           _prefix(prefix),
           _ident(std::move(ident)),
           _order(order)
@@ -572,13 +914,53 @@ namespace mongo {
             fassertFailedWithStatusNoTrace(40264, indexVersionStatus);
         }
 
+        _indexFormatVersion = indexFormatVersion;
+        // the filters only exist if the engine runs with a prefix extractor
+        _prefixBloomFilter = rocksGlobalOptions.indexPrefixBloomFilter &&
+                             config.getBoolField("prefix_bloom_filter");
         _keyStringVersion = indexFormatVersion >= kKeyStringV1Version ? KeyString::Version::V1
                                                                       : KeyString::Version::V0;
     }
 
     void RocksIndexBase::fullValidate(OperationContext* opCtx, long long* numKeysOut,
                                       ValidateResults* fullResults) const {
-        if (numKeysOut) {
+        const int validateMode = rocksGlobalOptions.validateMode.load();
+        const bool checksumOnly = validateMode == RocksGlobalOptions::kValidateModeChecksum;
+        if (fullResults && validateMode != RocksGlobalOptions::kValidateModeFull) {
+            // same as validation of the record store
+            long long numFiles = 0;
+            Status status = rocksVerifySstChecksumsInRange(_db, nullptr, _prefix,
+                                                           rocksGetNextPrefix(_prefix), &numFiles);
+            if (status.code() == ErrorCodes::CommandNotSupported) {
+                fullResults->warnings.push_back(str::stream() << "SST checksums not verified: "
+                                                              << status.reason());
+            } else if (!status.isOK()) {
+                fullResults->valid = false;
+                fullResults->errors.push_back(str::stream() << "SST checksum verification failed: "
+                                                            << status.reason());
+            }
+        }
+
+        if (numKeysOut && (rocksGlobalOptions.validateThreads > 1 || checksumOnly) &&
+            _oneEntryPerKey()) {
+            // Each thread counts the keys of its range. The keys aren't decoded, which is all the
+            // checksum mode needs: the collection validation compares the count.
+            std::vector<long long> rangeKeys(rocksGlobalOptions.validateThreads, 0);
+            auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
+            // skip the <prefix> key the engine adds when creating the ident
+            std::string begin(_prefix);
+            begin.push_back('\0');
+            uassertStatusOK(rocksParallelScan(
+                opCtx, _db, nullptr, ru->snapshot(), begin, rocksGetNextPrefix(_prefix),
+                rocksGlobalOptions.validateThreads,
+                [&](size_t range, const rocksdb::Slice& key, const rocksdb::Slice& value) {
+                    ++rangeKeys[range];
+                }));
+            *numKeysOut = 0;
+            for (long long keys : rangeKeys) {
+                *numKeysOut += keys;
+            }
+        } else if (numKeysOut) {
             std::unique_ptr<SortedDataInterface::Cursor> cursor(newCursor(opCtx, 1));
 
             *numKeysOut = 0;
@@ -610,16 +992,74 @@ namespace mongo {
             std::max(_indexStorageSize.load(std::memory_order_relaxed), static_cast<long long>(1)));
     }
 
+    Status RocksIndexBase::compact(OperationContext* opCtx) {
+        if (!_compactionScheduler) {
+            std::string nextPrefix = rocksGetNextPrefix(_prefix);
+            rocksdb::Slice beginRange(_prefix);
+            rocksdb::Slice endRange(nextPrefix);
+            return rocksToMongoStatus(
+                _db->CompactRange(rocksdb::CompactRangeOptions(), &beginRange, &endRange));
+        }
+        return _compactionScheduler->waitForCompaction(opCtx, scheduleCompaction());
+    }
+
+    std::shared_ptr<RocksCompactionTask> RocksIndexBase::scheduleCompaction() {
+        invariant(_compactionScheduler);
+        return _compactionScheduler->compactRangeTask(
+            "index " + _ident + " on " + _collectionNamespace, nullptr, _prefix,
+            rocksGetNextPrefix(_prefix));
+    }
+
     void RocksIndexBase::generateConfig(BSONObjBuilder* configBuilder, int formatVersion,
                                         IndexDescriptor::IndexVersion descVersion) {
-        if (formatVersion >= 3 && descVersion >= IndexDescriptor::IndexVersion::kV2) {
+        if (formatVersion >= 4 && descVersion >= IndexDescriptor::IndexVersion::kV2) {
           configBuilder->append("index_format_version", static_cast<int32_t>(kMaximumIndexVersion));
+        } else if (formatVersion >= 3 && descVersion >= IndexDescriptor::IndexVersion::kV2) {
+          configBuilder->append("index_format_version", static_cast<int32_t>(kKeyStringV1Version));
         } else {
           // keep it backwards compatible
           configBuilder->append("index_format_version", static_cast<int32_t>(kMinimumIndexVersion));
         }
     }
 
+    Status RocksIndexBase::validateStorageOptions(const BSONObj& options) {
+        for (auto&& elem : options) {
+            if (elem.fieldNameStringData() == "prefixBloomFilter") {
+                if (!elem.isBoolean()) {
+                    return Status(ErrorCodes::InvalidOptions,
+                                  "prefixBloomFilter must be a boolean");
+                }
+            } else {
+                return Status(ErrorCodes::InvalidOptions,
+                              str::stream() << "unknown rocksdb index option: "
+                                            << elem.fieldNameStringData());
+            }
+        }
+        return Status::OK();
+    }
+
+    void RocksIndexBase::generateStorageConfig(BSONObjBuilder* configBuilder,
+                                               const BSONObj& storageOptions) {
+        if (storageOptions.getBoolField("prefixBloomFilter")) {
+            configBuilder->append("prefix_bloom_filter", true);
+        }
+    }
+
+    void RocksIndexBase::_ingestBulkLoad(OperationContext* opCtx, RocksSstBulkLoader* loader,
+                                         long long storageBytes) {
+        // Bulk builders only run for foreground builds, which hold the collection exclusively,
+        // so nothing else writes to this prefix that the ingested files could shadow. Ingesting
+        // isn't part of the write batch though, so undo it by hand if the build rolls back.
+        uassertStatusOK(loader->ingest());
+        _indexStorageSize.fetch_add(storageBytes, std::memory_order_relaxed);
+        opCtx->recoveryUnit()->registerChange(
+            new BulkIngestChange(_dropPrefix, _prefix, &_indexStorageSize, storageBytes));
+    }
+
+    bool RocksIndexBase::_canIngestBulkLoad() const {
+        return RocksSstBulkLoader::isSupported() && _dropPrefix;
+    }
+
     std::string RocksIndexBase::_makePrefixedKey(const std::string& prefix,
                                                  const KeyString& encodedKey) {
         std::string key(prefix);
@@ -634,9 +1074,12 @@ namespace mongo {
                                        std::string collectionNamespace, std::string indexName,
                                        bool partial)
         : RocksIndexBase(db, prefix, ident, order, config),
-          _collectionNamespace(std::move(collectionNamespace)),
           _indexName(std::move(indexName)),
-          _partial(partial) {}
+          _partial(partial),
+          _keyWithRecordId(_indexFormatVersion >= kUniqueKeyWithRecordIdVersion),
+          _idCache(nullptr) {
+        _collectionNamespace = std::move(collectionNamespace);
+    }
 
     Status RocksUniqueIndex::insert(OperationContext* opCtx, const BSONObj& key, const RecordId& loc,
                                     bool dupsAllowed) {
@@ -649,9 +1092,37 @@ namespace mongo {
         std::string prefixedKey(_makePrefixedKey(_prefix, encodedKey));
 
         auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
+        // In the <key><RecordId> format the key without RecordId isn't stored, but registering it
+        // still serializes concurrent inserts of the same key with different records
         if (!ru->transaction()->registerWrite(prefixedKey)) {
             throw WriteConflictException();
         }
+        _invalidateIdCache(ru, prefixedKey);
+
+        if (_keyWithRecordId) {
+            if (!dupsAllowed) {
+                bool alreadyIndexed = false;
+                Status status = _checkDupsWithRecordId(opCtx, key, encodedKey, loc,
+                                                       &alreadyIndexed);
+                if (!status.isOK() || alreadyIndexed) {
+                    return status;
+                }
+            }
+
+            // TypeBits are kept aside before appending the RecordId, which doesn't touch them
+            encodedKey.appendRecordId(loc);
+            std::string keyWithRecordId(_makePrefixedKey(_prefix, encodedKey));
+            rocksdb::Slice value;
+            if (!encodedKey.getTypeBits().isAllZeros()) {
+                value = rocksdb::Slice(
+                    reinterpret_cast<const char*>(encodedKey.getTypeBits().getBuffer()),
+                    encodedKey.getTypeBits().getSize());
+            }
+            _indexStorageSize.fetch_add(static_cast<long long>(keyWithRecordId.size()),
+                                        std::memory_order_relaxed);
+            ru->writeBatch()->Put(keyWithRecordId, value);
+            return Status::OK();
+        }
 
         _indexStorageSize.fetch_add(static_cast<long long>(prefixedKey.size()),
                                     std::memory_order_relaxed);
@@ -734,6 +1205,24 @@ namespace mongo {
         if (!ru->transaction()->registerWrite(prefixedKey)) {
             throw WriteConflictException();
         }
+        _invalidateIdCache(ru, prefixedKey);
+
+        if (_keyWithRecordId) {
+            // The entry for loc is known, but it may be missing (e.g. filtered out by a partial
+            // index), and then the index size mustn't change
+            encodedKey.appendRecordId(loc);
+            std::string keyWithRecordId(_makePrefixedKey(_prefix, encodedKey));
+            std::string value;
+            auto getStatus = ru->Get(keyWithRecordId, &value);
+            if (getStatus.IsNotFound()) {
+                return;
+            }
+            invariantRocksOK(getStatus);
+            _indexStorageSize.fetch_sub(static_cast<long long>(keyWithRecordId.size()),
+                                        std::memory_order_relaxed);
+            ru->writeBatch()->Delete(keyWithRecordId);
+            return;
+        }
 
         if (!dupsAllowed) {
             if (_partial) {
@@ -817,13 +1306,26 @@ namespace mongo {
 
     std::unique_ptr<SortedDataInterface::Cursor> RocksUniqueIndex::newCursor(OperationContext* opCtx,
                                                                              bool forward) const {
-        return stdx::make_unique<RocksUniqueCursor>(opCtx, _db, _prefix, forward, _order,
-                                                    _keyStringVersion);
+        std::unique_ptr<RocksCursorBase> cursor;
+        if (_keyWithRecordId) {
+            cursor = stdx::make_unique<RocksStandardCursor>(opCtx, _db, _prefix, forward, _order,
+                                                            _keyStringVersion, _prefixBloomFilter);
+        } else {
+            cursor = stdx::make_unique<RocksUniqueCursor>(opCtx, _db, _prefix, forward, _order,
+                                                          _keyStringVersion);
+        }
+        if (forward) {
+            cursor->setIdCache(_idCache);
+        }
+        return std::move(cursor);
     }
 
     Status RocksUniqueIndex::dupKeyCheck(OperationContext* opCtx, const BSONObj& key,
                                          const RecordId& loc) {
         KeyString encodedKey(_keyStringVersion, key, _order);
+        if (_keyWithRecordId) {
+            return _checkDupsWithRecordId(opCtx, key, encodedKey, loc, nullptr);
+        }
         std::string prefixedKey(_makePrefixedKey(_prefix, encodedKey));
 
         auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
@@ -852,9 +1354,44 @@ namespace mongo {
 
     SortedDataBuilderInterface* RocksUniqueIndex::getBulkBuilder(OperationContext* opCtx,
                                                                  bool dupsAllowed) {
-        return new RocksIndexBase::UniqueBulkBuilder(_prefix, _order, _keyStringVersion,
-                                                     _collectionNamespace, _indexName, opCtx,
-                                                     dupsAllowed);
+        return new RocksIndexBase::UniqueBulkBuilder(this, _prefix, _order,
+                                                     _keyStringVersion, _collectionNamespace,
+                                                     _indexName, opCtx, dupsAllowed,
+                                                     _keyWithRecordId);
+    }
+
+    void RocksUniqueIndex::_invalidateIdCache(RocksRecoveryUnit* ru,
+                                              const std::string& prefixedKey) {
+        if (!_idCache) {
+            return;
+        }
+        _idCache->beginWrite(prefixedKey);
+        ru->registerChange(new IdCacheWriteChange(_idCache, _db, prefixedKey));
+    }
+
+    Status RocksUniqueIndex::_checkDupsWithRecordId(OperationContext* opCtx, const BSONObj& key,
+                                                    const KeyString& encodedKey,
+                                                    const RecordId& loc, bool* foundLoc) {
+        invariant(_keyWithRecordId);
+        // All entries of a key are adjacent and start with the key's encoding without RecordId.
+        // No other key shares that prefix since the encoding ends with kEnd, which can't appear
+        // at the start of an element.
+        const rocksdb::Slice keySlice(encodedKey.getBuffer(), encodedKey.getSize());
+        auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
+        std::unique_ptr<RocksIterator> iter(_prefixBloomFilter ? ru->NewPrefixSeekIterator(_prefix)
+                                                               : ru->NewIterator(_prefix));
+        for (iter->Seek(keySlice); iter->Valid() && iter->key().starts_with(keySlice);
+             iter->Next()) {
+            auto indexKey = iter->key();
+            if (KeyString::decodeRecordIdAtEnd(indexKey.data(), indexKey.size()) != loc) {
+                return Status(ErrorCodes::DuplicateKey,
+                              dupKeyError(key, _collectionNamespace, _indexName));
+            }
+            if (foundLoc) {
+                *foundLoc = true;
+            }
+        }
+        return rocksToMongoStatus(iter->status());
     }
 
     /// RocksStandardIndex
@@ -930,7 +1467,7 @@ namespace mongo {
             OperationContext* opCtx,
             bool forward) const {
         return stdx::make_unique<RocksStandardCursor>(opCtx, _db, _prefix, forward, _order,
-                                                      _keyStringVersion);
+                                                      _keyStringVersion, _prefixBloomFilter);
     }
 
     SortedDataBuilderInterface* RocksStandardIndex::getBulkBuilder(OperationContext* opCtx,
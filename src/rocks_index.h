@@ -30,6 +30,8 @@
 
 #include <atomic>
 #include <boost/shared_ptr.hpp>
+#include <functional>
+#include <memory>
 #include <string>
 
 #include <rocksdb/db.h>
@@ -46,7 +48,11 @@ namespace rocksdb {
 
 namespace mongo {
 
+    class RocksCompactionScheduler;
+    class RocksCompactionTask;
+    class RocksIdCache;
     class RocksRecoveryUnit;
+    class RocksSstBulkLoader;
 
     class RocksIndexBase : public SortedDataInterface {
         MONGO_DISALLOW_COPYING(RocksIndexBase);
@@ -73,13 +79,53 @@ namespace mongo {
 
         virtual long long getSpaceUsedBytes( OperationContext* opCtx ) const;
 
+        virtual Status compact(OperationContext* opCtx);
+
+        // Without a compaction scheduler compact() runs synchronously and can't be interrupted
+        void setCompactionScheduler(RocksCompactionScheduler* compactionScheduler,
+                                    std::string collectionNamespace) {
+            _compactionScheduler = compactionScheduler;
+            _collectionNamespace = std::move(collectionNamespace);
+        }
+        const std::string& collectionNamespace() const { return _collectionNamespace; }
+
+        // Deletes every key of a prefix without a write batch, see RocksEngine::dropPrefix()
+        typedef std::function<Status(const std::string& prefix)> DropPrefixFunction;
+        // Bulk builders only ingest SST files if they can drop them again on rollback
+        void setDropPrefixFunction(DropPrefixFunction dropPrefix) {
+            _dropPrefix = std::move(dropPrefix);
+        }
+
+        // Schedules a compaction of the whole index without waiting for it. Requires a
+        // compaction scheduler.
+        std::shared_ptr<RocksCompactionTask> scheduleCompaction();
+
         static void generateConfig(BSONObjBuilder* configBuilder, int formatVersion,
                                    IndexDescriptor::IndexVersion descVersion);
 
+        // Index options given in the index spec as {storageEngine: {rocksdb: <options>}}
+        static Status validateStorageOptions(const BSONObj& options);
+        static void generateStorageConfig(BSONObjBuilder* configBuilder,
+                                          const BSONObj& storageOptions);
+
     protected:
         static std::string _makePrefixedKey(const std::string& prefix, const KeyString& encodedKey);
 
+        // Ingests the keys a bulk builder loaded as part of the current unit of work, see
+        // BulkIngestChange
+        void _ingestBulkLoad(OperationContext* opCtx, RocksSstBulkLoader* loader,
+                             long long storageBytes);
+        bool _canIngestBulkLoad() const;
+
+        // true if every rocksdb key is exactly one index entry, which lets fullValidate count
+        // raw keys instead of decoding them
+        virtual bool _oneEntryPerKey() const { return false; }
+
         rocksdb::DB* _db; // not owned
+        RocksCompactionScheduler* _compactionScheduler; // not owned, can be nullptr
+        std::string _collectionNamespace;
+        // empty if bulk loads can't be dropped
+        DropPrefixFunction _dropPrefix;
 
         // Each key in the index is prefixed with _prefix
         std::string _prefix;
@@ -90,7 +136,10 @@ namespace mongo {
 
         // used to construct RocksCursors
         const Ordering _order;
+        int _indexFormatVersion;
         KeyString::Version _keyStringVersion;
+        // true if lookups of a single key may use prefix bloom filters
+        bool _prefixBloomFilter;
 
         class StandardBulkBuilder;
         class UniqueBulkBuilder;
@@ -114,10 +163,30 @@ namespace mongo {
 
         virtual SortedDataBuilderInterface* getBulkBuilder(OperationContext* opCtx,
                                                            bool dupsAllowed) override;
+
+        // For the _id index: serve seekExact() of forward cursors from idCache
+        void setIdCache(RocksIdCache* idCache) { _idCache = idCache; }
+
+    protected:
+        virtual bool _oneEntryPerKey() const { return _keyWithRecordId; }
+
     private:
-        std::string _collectionNamespace;
+        // Only for indexes that keep the RecordId in the key. Returns DuplicateKey if the key is
+        // indexed for a record other than loc, and sets *foundLoc (if given) when it's indexed
+        // for loc.
+        Status _checkDupsWithRecordId(OperationContext* opCtx, const BSONObj& key,
+                                      const KeyString& encodedKey, const RecordId& loc,
+                                      bool* foundLoc);
+
+        // Keeps the _id cache from serving prefixedKey until the unit of work ends
+        void _invalidateIdCache(RocksRecoveryUnit* ru, const std::string& prefixedKey);
+
         std::string _indexName;
         const bool _partial;
+        // true if entries are stored as <key><RecordId> -> TypeBits instead of
+        // <key> -> list of <RecordId, TypeBits>
+        const bool _keyWithRecordId;
+        RocksIdCache* _idCache;  // not owned, can be nullptr
     };
 
     class RocksStandardIndex : public RocksIndexBase {
@@ -141,6 +210,9 @@ namespace mongo {
 
         void enableSingleDelete() { useSingleDelete = true; }
 
+    protected:
+        virtual bool _oneEntryPerKey() const { return true; }
+
     private:
         bool useSingleDelete;
     };
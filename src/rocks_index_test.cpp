@@ -30,24 +30,32 @@
 
 #include <boost/filesystem/operations.hpp>
 #include <string>
+#include <vector>
 
 #include <rocksdb/comparator.h>
 #include <rocksdb/db.h>
 #include <rocksdb/options.h>
 #include <rocksdb/slice.h>
+#include <rocksdb/write_batch.h>
 
+#include "mongo/base/checked_cast.h"
 #include "mongo/base/init.h"
 #include "mongo/db/concurrency/write_conflict_exception.h"
 #include "mongo/db/storage/sorted_data_interface_test_harness.h"
 #include "mongo/stdx/memory.h"
 #include "mongo/unittest/temp_dir.h"
 #include "mongo/unittest/unittest.h"
+#include "mongo/util/scopeguard.h"
 
 #include "rocks_engine.h"
+#include "rocks_global_options.h"
+#include "rocks_id_cache.h"
 #include "rocks_index.h"
 #include "rocks_recovery_unit.h"
 #include "rocks_transaction.h"
 #include "rocks_snapshot_manager.h"
+#include "rocks_sst_bulk_loader.h"
+#include "rocks_util.h"
 
 namespace mongo {
 namespace {
@@ -56,7 +64,11 @@ namespace {
 
     class RocksIndexHarness final : public SortedDataInterfaceHarnessHelper {
     public:
-        RocksIndexHarness() : _order(Ordering::make(BSONObj())), _tempDir(_testNamespace) {
+        RocksIndexHarness(int formatVersion = 3, bool prefixBloomFilter = false)
+            : _formatVersion(formatVersion),
+              _prefixBloomFilter(prefixBloomFilter),
+              _order(Ordering::make(BSONObj())),
+              _tempDir(_testNamespace) {
             boost::filesystem::remove_all(_tempDir.path());
             rocksdb::DB* db;
             rocksdb::Options options;
@@ -68,26 +80,61 @@ namespace {
             _durabilityManager.reset(new RocksDurabilityManager(_db.get(), true));
         }
 
+        using SortedDataInterfaceHarnessHelper::newSortedDataInterface;
+
         std::unique_ptr<SortedDataInterface> newSortedDataInterface(bool unique) {
             BSONObjBuilder configBuilder;
-            RocksIndexBase::generateConfig(&configBuilder, 3, IndexDescriptor::IndexVersion::kV2);
+            RocksIndexBase::generateConfig(&configBuilder, _formatVersion,
+                                           IndexDescriptor::IndexVersion::kV2);
+            if (_prefixBloomFilter) {
+                RocksIndexBase::generateStorageConfig(&configBuilder,
+                                                      BSON("prefixBloomFilter" << true));
+            }
+            std::unique_ptr<RocksIndexBase> index;
             if (unique) {
-                return stdx::make_unique<RocksUniqueIndex>(_db.get(), "prefix", "ident", _order,
-                                                           configBuilder.obj(), "test.rocks",
-                                                           "testIndex");
+                index = stdx::make_unique<RocksUniqueIndex>(_db.get(), "prefix", "ident", _order,
+                                                            configBuilder.obj(), "test.rocks",
+                                                            "testIndex");
             } else {
-                return stdx::make_unique<RocksStandardIndex>(_db.get(), "prefix", "ident", _order,
-                                                             configBuilder.obj());
+                index = stdx::make_unique<RocksStandardIndex>(_db.get(), "prefix", "ident", _order,
+                                                              configBuilder.obj());
             }
+            index->setDropPrefixFunction(
+                [this](const std::string& prefix) { return _dropPrefix(prefix); });
+            return std::move(index);
         }
 
+        const std::vector<std::string>& droppedPrefixes() const { return _droppedPrefixes; }
+
         std::unique_ptr<RecoveryUnit> newRecoveryUnit() {
             return stdx::make_unique<RocksRecoveryUnit>(&_transactionEngine, &_snapshotManager,
                                                         _db.get(), _counterManager.get(),
-                                                        nullptr, _durabilityManager.get(), true);
+                                                        nullptr, _durabilityManager.get(), true,
+                                                        _indexWritesLazily);
+        }
+
+        void setIndexWritesLazily(bool indexWritesLazily) {
+            _indexWritesLazily = indexWritesLazily;
         }
 
     private:
+        // stands in for the engine's dropped prefix compactions
+        Status _dropPrefix(const std::string& prefix) {
+            _droppedPrefixes.push_back(prefix);
+            rocksdb::WriteBatch wb;
+            std::unique_ptr<rocksdb::Iterator> iter(_db->NewIterator(rocksdb::ReadOptions()));
+            for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix);
+                 iter->Next()) {
+                wb.Delete(iter->key());
+            }
+            invariantRocksOK(iter->status());
+            invariantRocksOK(_db->Write(rocksdb::WriteOptions(), &wb));
+            return Status::OK();
+        }
+
+        int _formatVersion;
+        bool _prefixBloomFilter;
+        bool _indexWritesLazily = false;
         Ordering _order;
         string _testNamespace = "mongo-rocks-sorted-data-test";
         unittest::TempDir _tempDir;
@@ -96,6 +143,7 @@ namespace {
         RocksSnapshotManager _snapshotManager;
         std::unique_ptr<RocksDurabilityManager> _durabilityManager;
         std::unique_ptr<RocksCounterManager> _counterManager;
+        std::vector<std::string> _droppedPrefixes;
     };
 
     std::unique_ptr<HarnessHelper> makeHarnessHelper() {
@@ -204,5 +252,367 @@ namespace {
     TEST(RocksIndexTest, SeekExactRemoveNext_Reverse_Standard) {
         testSeekExactRemoveNext(false, false);
     }
+
+    TEST(RocksIndexTest, UniqueKeyWithRecordId) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>(4);
+        const std::unique_ptr<SortedDataInterface>
+        sorted(harnessHelper->newSortedDataInterface(true));
+
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(sorted->insert(opCtx.get(), key1, loc1, false));
+            ASSERT_OK(sorted->insert(opCtx.get(), key2, loc2, false));
+            // inserting the same entry again is not a duplicate
+            ASSERT_OK(sorted->insert(opCtx.get(), key1, loc1, false));
+            ASSERT_EQUALS(ErrorCodes::DuplicateKey,
+                          sorted->insert(opCtx.get(), key1, loc3, false).code());
+            ASSERT_OK(sorted->dupKeyCheck(opCtx.get(), key1, loc1));
+            ASSERT_EQUALS(ErrorCodes::DuplicateKey,
+                          sorted->dupKeyCheck(opCtx.get(), key1, loc3).code());
+            uow.commit();
+        }
+
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            ASSERT_EQUALS(2, sorted->numEntries(opCtx.get()));
+            auto cursor = sorted->newCursor(opCtx.get());
+            ASSERT_EQ(cursor->seekExact(key1), IndexKeyEntry(key1, loc1));
+            ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc2));
+        }
+
+        {
+            // a dupsAllowed insert adds a second entry for the key
+            auto opCtx = harnessHelper->newOperationContext();
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(sorted->insert(opCtx.get(), key1, loc3, true));
+            uow.commit();
+        }
+
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            auto cursor = sorted->newCursor(opCtx.get());
+            ASSERT_EQ(cursor->seek(key1, true), IndexKeyEntry(key1, loc1));
+            ASSERT_EQ(cursor->next(), IndexKeyEntry(key1, loc3));
+            ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc2));
+
+            WriteUnitOfWork uow(opCtx.get());
+            sorted->unindex(opCtx.get(), key1, loc1, true);
+            sorted->unindex(opCtx.get(), key1, loc3, true);
+            ASSERT_OK(sorted->insert(opCtx.get(), key1, loc4, false));
+            uow.commit();
+        }
+
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            ASSERT_EQUALS(2, sorted->numEntries(opCtx.get()));
+            auto cursor = sorted->newCursor(opCtx.get());
+            ASSERT_EQ(cursor->seekExact(key1), IndexKeyEntry(key1, loc4));
+        }
+
+        {
+            // unindexing an entry that isn't there (e.g. filtered out by a partial index) leaves
+            // the size alone
+            auto opCtx = harnessHelper->newOperationContext();
+            const long long spaceUsed = sorted->getSpaceUsedBytes(opCtx.get());
+            WriteUnitOfWork uow(opCtx.get());
+            sorted->unindex(opCtx.get(), key3, loc1, false);
+            sorted->unindex(opCtx.get(), key1, loc1, true);
+            uow.commit();
+            ASSERT_EQUALS(spaceUsed, sorted->getSpaceUsedBytes(opCtx.get()));
+            ASSERT_EQUALS(2, sorted->numEntries(opCtx.get()));
+        }
+    }
+
+    void testPrefixBloomSeekExact(bool unique) {
+        rocksGlobalOptions.indexPrefixBloomFilter = true;
+        ON_BLOCK_EXIT([] { rocksGlobalOptions.indexPrefixBloomFilter = false; });
+
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>(4, true);
+        auto opCtx = harnessHelper->newOperationContext();
+        auto sorted = harnessHelper->newSortedDataInterface(unique,
+                {{key1, loc1}, {key3, loc1}, {key3, loc2}, {key4, loc1}});
+        if (unique) {
+            ASSERT_OK(sorted->dupKeyCheck(opCtx.get(), key2, loc1));
+            ASSERT_EQUALS(ErrorCodes::DuplicateKey,
+                          sorted->dupKeyCheck(opCtx.get(), key4, loc2).code());
+        }
+
+        auto cursor = sorted->newCursor(opCtx.get());
+        ASSERT_EQ(cursor->seekExact(key2), boost::none);
+        // the cursor keeps working in total order after a prefix lookup
+        ASSERT_EQ(cursor->seekExact(key3), IndexKeyEntry(key3, loc1));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key3, loc2));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key4, loc1));
+        ASSERT_EQ(cursor->next(), boost::none);
+    }
+
+    TEST(RocksIndexTest, PrefixBloomSeekExact_Unique) {
+        testPrefixBloomSeekExact(true);
+    }
+
+    TEST(RocksIndexTest, PrefixBloomSeekExact_Standard) {
+        testPrefixBloomSeekExact(false);
+    }
+
+    TEST(RocksIndexTest, PrefixBloomEqualityRange) {
+        rocksGlobalOptions.indexPrefixBloomFilter = true;
+        ON_BLOCK_EXIT([] { rocksGlobalOptions.indexPrefixBloomFilter = false; });
+
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>(4, true);
+        auto opCtx = harnessHelper->newOperationContext();
+        auto sorted = harnessHelper->newSortedDataInterface(false,
+                {{key1, loc1}, {key2, loc1}, {key2, loc2}, {key3, loc1}});
+
+        WriteUnitOfWork uow(opCtx.get());
+        // entries in the write batch aren't covered by the iterator bounds
+        ASSERT_OK(sorted->insert(opCtx.get(), key2, loc3, true));
+        ASSERT_OK(sorted->insert(opCtx.get(), key3, loc2, true));
+
+        auto cursor = sorted->newCursor(opCtx.get());
+        cursor->setEndPosition(key2, true);
+        ASSERT_EQ(cursor->seek(key2, true), IndexKeyEntry(key2, loc1));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc2));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc3));
+        ASSERT_EQ(cursor->next(), boost::none);
+
+        // a range that isn't an equality uses the regular iterator again
+        cursor->setEndPosition(key3, true);
+        ASSERT_EQ(cursor->seek(key1, false), IndexKeyEntry(key2, loc1));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc2));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc3));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key3, loc1));
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key3, loc2));
+        ASSERT_EQ(cursor->next(), boost::none);
+
+        auto reverseCursor = sorted->newCursor(opCtx.get(), false);
+        reverseCursor->setEndPosition(key2, false);
+        ASSERT_EQ(reverseCursor->seek(key3, true), IndexKeyEntry(key3, loc2));
+        ASSERT_EQ(reverseCursor->next(), IndexKeyEntry(key3, loc1));
+        ASSERT_EQ(reverseCursor->next(), boost::none);
+    }
+
+    TEST(RocksIndexTest, DecodedKeyKeepsTypeBits) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>();
+        auto opCtx = harnessHelper->newOperationContext();
+        // same KeyString bytes, different TypeBits
+        auto sorted = harnessHelper->newSortedDataInterface(false,
+                {{BSON("" << 1), loc1}, {BSON("" << 1.0), loc2}, {BSON("" << 1.0), loc3},
+                 {BSON("" << 1.0), loc4}});
+
+        auto cursor = sorted->newCursor(opCtx.get());
+        auto entry = cursor->seek(BSON("" << 1), true);
+        ASSERT(entry);
+        ASSERT_EQ(entry->loc, loc1);
+        ASSERT_EQ(entry->key.firstElement().type(), NumberInt);
+        entry = cursor->next();
+        ASSERT(entry);
+        ASSERT_EQ(entry->loc, loc2);
+        ASSERT_EQ(entry->key.firstElement().type(), NumberDouble);
+        entry = cursor->next(SortedDataInterface::Cursor::kWantLoc);
+        ASSERT(entry);
+        ASSERT_EQ(entry->loc, loc3);
+        ASSERT(entry->key.isEmpty());
+        ASSERT(cursor->next(SortedDataInterface::Cursor::kJustExistance));
+        ASSERT_EQ(cursor->next(), boost::none);
+    }
+
+    TEST(RocksIndexTest, UniqueKeyWithRecordIdConflict) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>(4);
+        const std::unique_ptr<SortedDataInterface>
+        sorted(harnessHelper->newSortedDataInterface(true));
+
+        const ServiceContext::UniqueOperationContext t1(harnessHelper->newOperationContext());
+        const auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+        const auto t2 = harnessHelper->newOperationContext(client2.get());
+
+        WriteUnitOfWork w1(t1.get());
+        WriteUnitOfWork w2(t2.get());
+
+        // the entries differ in RecordId, but the key must still conflict
+        ASSERT_OK(sorted->insert(t1.get(), key1, loc1, false));
+        ASSERT_THROWS(sorted->insert(t2.get(), key1, loc2, false), WriteConflictException);
+        w1.commit();
+    }
+
+    TEST(RocksIndexTest, CursorSeesWritesAfterOpen) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>();
+        auto opCtx = harnessHelper->newOperationContext();
+        auto sorted = harnessHelper->newSortedDataInterface(false, {{key1, loc1}, {key3, loc1}});
+
+        // opened without pending writes, so it starts out reading the DB directly
+        auto cursor = sorted->newCursor(opCtx.get());
+        ASSERT_EQ(cursor->seek(key1, true), IndexKeyEntry(key1, loc1));
+
+        WriteUnitOfWork uow(opCtx.get());
+        ASSERT_OK(sorted->insert(opCtx.get(), key2, loc1, true));
+        sorted->unindex(opCtx.get(), key3, loc1, true);
+        ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc1));
+        ASSERT_EQ(cursor->next(), boost::none);
+    }
+
+    void testIdCache(int formatVersion) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>(formatVersion);
+        auto sorted = harnessHelper->newSortedDataInterface(true, {{key1, loc1}});
+        RocksIdCache idCache(100);
+        checked_cast<RocksUniqueIndex*>(sorted.get())->setIdCache(&idCache);
+
+        const ServiceContext::UniqueOperationContext t1(harnessHelper->newOperationContext());
+        const auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+        const auto t2 = harnessHelper->newOperationContext(client2.get());
+
+        // the second lookup is served from the cache
+        ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key1), IndexKeyEntry(key1, loc1));
+        ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key1), IndexKeyEntry(key1, loc1));
+        BSONObjBuilder stats;
+        idCache.appendStats(&stats);
+        ASSERT_EQUALS(1, stats.obj()["hits"].numberLong());
+
+        {
+            WriteUnitOfWork uow(t2.get());
+            sorted->unindex(t2.get(), key1, loc1, false);
+            ASSERT_OK(sorted->insert(t2.get(), key1, loc2, false));
+            // t2 doesn't see the cached entry while it writes the key
+            ASSERT_EQ(sorted->newCursor(t2.get())->seekExact(key1), IndexKeyEntry(key1, loc2));
+            uow.commit();
+        }
+
+        // t1's snapshot is older than the update
+        ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key1), IndexKeyEntry(key1, loc1));
+        t1->recoveryUnit()->abandonSnapshot();
+        ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key1), IndexKeyEntry(key1, loc2));
+        ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key1), IndexKeyEntry(key1, loc2));
+        ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key2), boost::none);
+    }
+
+    TEST(RocksIndexTest, IdCache) {
+        testIdCache(3);
+    }
+
+    TEST(RocksIndexTest, IdCacheKeyWithRecordId) {
+        testIdCache(4);
+    }
+
+    TEST(RocksIndexTest, IdCacheHitsWhileOtherKeysAreWritten) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>();
+        auto sorted = harnessHelper->newSortedDataInterface(true, {{key1, loc1}});
+        RocksIdCache idCache(64 * 1024);
+        checked_cast<RocksUniqueIndex*>(sorted.get())->setIdCache(&idCache);
+
+        const ServiceContext::UniqueOperationContext t1(harnessHelper->newOperationContext());
+        const auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+        const auto t2 = harnessHelper->newOperationContext(client2.get());
+
+        ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key1), IndexKeyEntry(key1, loc1));
+
+        // enough uncommitted writes to other keys to cover every shard of the cache
+        WriteUnitOfWork uow(t2.get());
+        for (int i = 0; i < 1000; i++) {
+            ASSERT_OK(sorted->insert(t2.get(), BSON("" << ("other" + std::to_string(i))), loc2,
+                                     false));
+        }
+
+        for (int i = 0; i < 10; i++) {
+            ASSERT_EQ(sorted->newCursor(t1.get())->seekExact(key1), IndexKeyEntry(key1, loc1));
+        }
+        BSONObjBuilder stats;
+        idCache.appendStats(&stats);
+        ASSERT_EQUALS(10, stats.obj()["hits"].numberLong());
+        uow.commit();
+    }
+
+    void testBulkLoad(bool unique) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>();
+        auto sorted = harnessHelper->newSortedDataInterface(unique);
+
+        {
+            // rolled back builds leave nothing behind
+            auto opCtx = harnessHelper->newOperationContext();
+            WriteUnitOfWork uow(opCtx.get());
+            std::unique_ptr<SortedDataBuilderInterface> builder(
+                sorted->getBulkBuilder(opCtx.get(), true));
+            ASSERT_OK(builder->addKey(key1, loc1));
+            ASSERT_OK(builder->addKey(key2, loc1));
+            builder->commit(false);
+        }
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            ASSERT_EQ(sorted->newCursor(opCtx.get())->seek(BSONObj(), true), boost::none);
+            if (RocksSstBulkLoader::isSupported()) {
+                // the ingested keys are counted only while they're in the index, and they're
+                // dropped the way the engine drops idents
+                ASSERT_EQ(sorted->getSpaceUsedBytes(opCtx.get()), 1);
+                ASSERT_EQ(harnessHelper->droppedPrefixes().size(), 1U);
+                ASSERT_EQ(harnessHelper->droppedPrefixes()[0], "prefix");
+            }
+        }
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            WriteUnitOfWork uow(opCtx.get());
+            std::unique_ptr<SortedDataBuilderInterface> builder(
+                sorted->getBulkBuilder(opCtx.get(), true));
+            ASSERT_OK(builder->addKey(key1, loc1));
+            ASSERT_OK(builder->addKey(key2, loc1));
+            ASSERT_OK(builder->addKey(key3, loc1));
+            builder->commit(false);
+            uow.commit();
+        }
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            auto cursor = sorted->newCursor(opCtx.get());
+            ASSERT_EQ(cursor->seek(BSONObj(), true), IndexKeyEntry(key1, loc1));
+            ASSERT_EQ(cursor->next(), IndexKeyEntry(key2, loc1));
+            ASSERT_EQ(cursor->next(), IndexKeyEntry(key3, loc1));
+            ASSERT_EQ(cursor->next(), boost::none);
+            ASSERT_GT(sorted->getSpaceUsedBytes(opCtx.get()), 1);
+        }
+    }
+
+    TEST(RocksIndexTest, BulkLoad_Standard) {
+        testBulkLoad(false);
+    }
+
+    TEST(RocksIndexTest, BulkLoad_Unique) {
+        testBulkLoad(true);
+    }
+
+    TEST(RocksIndexTest, LazilyIndexedWriteBatch) {
+        auto harnessHelper = stdx::make_unique<RocksIndexHarness>();
+        harnessHelper->setIndexWritesLazily(true);
+        auto sorted = harnessHelper->newSortedDataInterface(false);
+        auto unique = harnessHelper->newSortedDataInterface(true);
+
+        {
+            // write-only unit of work
+            auto opCtx = harnessHelper->newOperationContext();
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(sorted->insert(opCtx.get(), key1, loc1, true));
+            uow.commit();
+        }
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(sorted->insert(opCtx.get(), key2, loc1, true));
+            sorted->unindex(opCtx.get(), key1, loc1, true);
+            // reading our own writes indexes the batch
+            auto cursor = sorted->newCursor(opCtx.get());
+            ASSERT_EQ(cursor->seek(BSONObj(), true), IndexKeyEntry(key2, loc1));
+            ASSERT_EQ(cursor->next(), boost::none);
+            ASSERT_OK(sorted->insert(opCtx.get(), key3, loc1, true));
+            // the unique index checks for duplicates through Get()
+            ASSERT_OK(unique->insert(opCtx.get(), key1, loc1, false));
+            ASSERT_EQUALS(ErrorCodes::DuplicateKey,
+                          unique->insert(opCtx.get(), key1, loc2, false));
+            uow.commit();
+        }
+        {
+            auto opCtx = harnessHelper->newOperationContext();
+            auto cursor = sorted->newCursor(opCtx.get());
+            ASSERT_EQ(cursor->seek(BSONObj(), true), IndexKeyEntry(key2, loc1));
+            ASSERT_EQ(cursor->next(), IndexKeyEntry(key3, loc1));
+            ASSERT_EQ(cursor->next(), boost::none);
+            ASSERT_EQ(unique->newCursor(opCtx.get())->seekExact(key1), IndexKeyEntry(key1, loc1));
+        }
+    }
 } // namespace
 } // namespace mongo
@@ -27,6 +27,8 @@
  *    it in the license file.
  */
 
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
 #include "mongo/platform/basic.h"
 
 #include "mongo/base/init.h"
@@ -34,9 +36,12 @@
 #include "mongo/db/storage/storage_options.h"
 #include "mongo/db/storage/kv/kv_storage_engine.h"
 #include "mongo/db/storage/storage_engine_metadata.h"
+#include "mongo/util/log.h"
 #include "mongo/util/mongoutils/str.h"
 
 #include "rocks_engine.h"
+#include "rocks_global_options.h"
+#include "rocks_index.h"
 #include "rocks_server_status.h"
 #include "rocks_parameters.h"
 
@@ -56,8 +61,11 @@ namespace mongo {
                 // Mongo keeps some files in params.dbpath. To avoid collision, put out files under
                 // db/ directory
                 if (formatVersion == -1) {
-                    // it's a new database, set it to the newest rocksdb version kRocksFormatVersion
-                    formatVersion = kRocksFormatVersion;
+                    // it's a new database
+                    formatVersion = _newDatabaseFormatVersion();
+                } else if (rocksGlobalOptions.uniqueIndexRecordIdInKey && formatVersion < 4) {
+                    log() << "rocksdbUniqueIndexRecordIdInKey only applies to new databases, "
+                          << "this one has format version " << formatVersion;
                 }
                 auto engine = new RocksEngine(params.dbpath + "/db", params.dur, formatVersion,
                                               params.readOnly);
@@ -68,6 +76,8 @@ namespace mongo {
                 auto leaked4 __attribute__((unused)) = new RocksCompactServerParameter(engine);
                 auto leaked5 __attribute__((unused)) = new RocksCacheSizeParameter(engine);
                 auto leaked6 __attribute__((unused)) = new RocksOptionsParameter(engine);
+                auto leaked7 __attribute__((unused)) = new RocksCancelCompactionParameter(engine);
+                auto leaked8 __attribute__((unused)) = new RocksValidateModeParameter();
 
                 return new KVStorageEngine(engine, options);
             }
@@ -76,6 +86,10 @@ namespace mongo {
                 return kRocksDBEngineName;
             }
 
+            virtual Status validateIndexStorageOptions(const BSONObj& options) const {
+                return RocksIndexBase::validateStorageOptions(options);
+            }
+
             virtual Status validateMetadata(const StorageEngineMetadata& metadata,
                                             const StorageGlobalParams& params) const {
                 const BSONObj& options = metadata.getStorageEngineOptions();
@@ -112,7 +126,7 @@ namespace mongo {
 
             virtual BSONObj createMetadataOptions(const StorageGlobalParams& params) const {
                 BSONObjBuilder builder;
-                builder.append(kRocksFormatVersionString, kRocksFormatVersion);
+                builder.append(kRocksFormatVersionString, _newDatabaseFormatVersion());
                 return builder.obj();
             }
 
@@ -121,6 +135,11 @@ namespace mongo {
             }
 
         private:
+            int _newDatabaseFormatVersion() const {
+                // version 4 stays opt-in, so that older versions can still open new databases
+                return rocksGlobalOptions.uniqueIndexRecordIdInKey ? kRocksFormatVersion : 3;
+            }
+
             // Current disk format. We bump this number when we change the disk format. MongoDB will
             // fail to start if the versions don't match. In that case a user needs to run mongodump
             // and mongorestore.
@@ -130,9 +149,13 @@ namespace mongo {
             // * Version 2 reserves two prefixes for oplog. one prefix keeps the oplog
             // documents and another only keeps keys. That way, we can cleanup the oplog without
             // reading full documents
-            // * Version 3 (current) understands the Decimal128 index format. It also understands
+            // * Version 3 understands the Decimal128 index format. It also understands
             // the version 2, so it's backwards compatible, but not forward compatible
-            const int kRocksFormatVersion = 3;
+            // * Version 4 (current) creates unique indexes that store the RecordId in the key,
+            // the same way standard indexes do. Indexes created by version 3 keep their format.
+            // New databases only get it with rocksdbUniqueIndexRecordIdInKey, otherwise they are
+            // still created with version 3.
+            const int kRocksFormatVersion = 4;
             const int kMinSupportedRocksFormatVersion = 2;
             const std::string kRocksFormatVersionString = "rocksFormatVersion";
             int mutable formatVersion = -1;
@@ -0,0 +1,252 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+// Micro-benchmark for the storage.rocksdb options that change how RocksDB serves the engine's
+// point lookups and commits. It needs nothing but RocksDB: every run opens a scratch database
+// in <dir> with the options of RocksEngine::_options(), loads keys shaped like the engine's and
+// times the operation the option is meant to speed up.
+//
+//   rocks_options_bench <dir> lookups
+//       Random Get()s of records (<prefix><RecordId> -> 200 byte document) and of unique _id
+//       index keys (<prefix><KeyString of an ObjectId> -> RecordId), read from SST files, with
+//       the default binary search data block index and with dataBlockHashIndex.
+//
+//   rocks_options_bench <dir> commits
+//       Small write batches (one 100 byte record and one index key each, like a single document
+//       insert) committed by 1 to 128 threads at once, without and with pipelinedWrite.
+//
+// Results are printed as operations per second, one line per configuration. Run it on an idle
+// machine and compare the lines of one run; the absolute numbers depend on the machine.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rocksdb/cache.h>
+#include <rocksdb/db.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/options.h>
+#include <rocksdb/table.h>
+#include <rocksdb/version.h>
+#include <rocksdb/write_batch.h>
+
+namespace {
+
+    const int kNumKeys = 1000 * 1000;
+    const int kNumLookups = 2 * 1000 * 1000;
+    const int kNumCommits = 1000 * 1000;
+
+    std::string encodeBigEndian(uint64_t value, int bytes) {
+        std::string encoded(bytes, '\0');
+        for (int i = bytes - 1; i >= 0; --i) {
+            encoded[i] = static_cast<char>(value & 0xff);
+            value >>= 8;
+        }
+        return encoded;
+    }
+
+    // <prefix><big endian RecordId>, as RocksRecordStore writes it
+    std::string recordKey(uint64_t id) {
+        return encodeBigEndian(1, 4) + encodeBigEndian(id, 8);
+    }
+
+    // <prefix><KeyString of an ObjectId>, as a unique _id index writes it
+    std::string idIndexKey(uint64_t id) {
+        // ObjectId type byte, 4 bytes of time, 8 bytes of counter, end of key
+        return encodeBigEndian(2, 4) + '\x64' + encodeBigEndian(0x5a000000, 4) +
+            encodeBigEndian(id * 7919, 8) + '\x04';
+    }
+
+    // The parts of RocksEngine::_options() that matter for reads from SST files
+    rocksdb::Options engineOptions(bool dataBlockHashIndex) {
+        rocksdb::Options options;
+        options.create_if_missing = true;
+        rocksdb::BlockBasedTableOptions tableOptions;
+        // big enough to keep every block cached, so that the lookups measure the block search
+        tableOptions.block_cache = rocksdb::NewLRUCache(1024 * 1024 * 1024);
+        tableOptions.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, false));
+        tableOptions.block_size = 16 * 1024;
+        tableOptions.format_version = 2;
+        if (dataBlockHashIndex) {
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 16)
+            tableOptions.format_version = 4;
+            tableOptions.data_block_index_type =
+                rocksdb::BlockBasedTableOptions::kDataBlockBinaryAndHash;
+            tableOptions.data_block_hash_table_util_ratio = 0.75;
+#endif
+        }
+        options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(tableOptions));
+        options.write_buffer_size = 64 * 1024 * 1024;
+        options.target_file_size_base = 64 * 1024 * 1024;
+        options.level_compaction_dynamic_level_bytes = true;
+        options.optimize_filters_for_hits = true;
+        options.max_open_files = -1;
+        return options;
+    }
+
+    std::unique_ptr<rocksdb::DB> openScratchDB(const std::string& path,
+                                               const rocksdb::Options& options) {
+        rocksdb::DestroyDB(path, options);
+        rocksdb::DB* db;
+        auto s = rocksdb::DB::Open(options, path, &db);
+        if (!s.ok()) {
+            fprintf(stderr, "can't open %s: %s\n", path.c_str(), s.ToString().c_str());
+            exit(1);
+        }
+        return std::unique_ptr<rocksdb::DB>(db);
+    }
+
+    void check(const rocksdb::Status& s) {
+        if (!s.ok()) {
+            fprintf(stderr, "%s\n", s.ToString().c_str());
+            exit(1);
+        }
+    }
+
+    double opsPerSecond(int ops, std::chrono::steady_clock::time_point start) {
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return ops / elapsed.count();
+    }
+
+    void benchLookups(const std::string& path, bool dataBlockHashIndex) {
+        auto db = openScratchDB(path, engineOptions(dataBlockHashIndex));
+        const std::string document(200, 'x');
+        for (int i = 0; i < kNumKeys; ++i) {
+            check(db->Put(rocksdb::WriteOptions(), recordKey(i), document));
+            check(db->Put(rocksdb::WriteOptions(), idIndexKey(i), encodeBigEndian(i, 8)));
+        }
+        check(db->CompactRange(rocksdb::CompactRangeOptions(), nullptr, nullptr));
+
+        std::mt19937_64 random(42);
+        std::vector<uint64_t> ids(kNumLookups);
+        for (auto& id : ids) {
+            id = random() % kNumKeys;
+        }
+        std::vector<std::string> recordKeys, indexKeys;
+        for (auto id : ids) {
+            recordKeys.push_back(recordKey(id));
+            indexKeys.push_back(idIndexKey(id));
+        }
+
+        std::string value;
+        for (const auto* keys : {&recordKeys, &indexKeys}) {
+            // once to warm up the block cache, once to measure
+            for (int pass = 0; pass < 2; ++pass) {
+                const auto start = std::chrono::steady_clock::now();
+                for (const auto& key : *keys) {
+                    check(db->Get(rocksdb::ReadOptions(), key, &value));
+                }
+                if (pass == 1) {
+                    printf("lookups %-7s dataBlockHashIndex=%d: %.0f ops/s\n",
+                           keys == &recordKeys ? "records" : "_id", dataBlockHashIndex,
+                           opsPerSecond(kNumLookups, start));
+                }
+            }
+        }
+    }
+
+    // The parts of RocksEngine::_options() that matter for commits
+    rocksdb::Options commitOptions(bool pipelinedWrite) {
+        rocksdb::Options options = engineOptions(false);
+        options.allow_concurrent_memtable_write = true;
+        options.enable_write_thread_adaptive_yield = true;
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 5)
+        options.enable_pipelined_write = pipelinedWrite;
+#endif
+        return options;
+    }
+
+    void benchCommits(const std::string& path, bool pipelinedWrite) {
+        const std::string document(100, 'x');
+        for (int numThreads = 1; numThreads <= 128; numThreads *= 2) {
+            auto db = openScratchDB(path, commitOptions(pipelinedWrite));
+            const int commitsPerThread = kNumCommits / numThreads;
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < numThreads; ++t) {
+                threads.emplace_back([&, t] {
+                    // commits aren't synced, the journal flusher syncs the WAL separately
+                    rocksdb::WriteOptions writeOptions;
+                    rocksdb::WriteBatch wb;
+                    for (int i = 0; i < commitsPerThread; ++i) {
+                        const uint64_t id = static_cast<uint64_t>(t) * commitsPerThread + i;
+                        wb.Clear();
+                        wb.Put(recordKey(id), document);
+                        wb.Put(idIndexKey(id), encodeBigEndian(id, 8));
+                        check(db->Write(writeOptions, &wb));
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            printf("commits threads=%-3d pipelinedWrite=%d: %.0f ops/s\n", numThreads,
+                   pipelinedWrite, opsPerSecond(commitsPerThread * numThreads, start));
+        }
+    }
+
+    int usage() {
+        fprintf(stderr, "usage: rocks_options_bench <scratch dir> lookups|commits\n");
+        return 2;
+    }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        return usage();
+    }
+    const std::string path(argv[1]);
+    const std::string benchmark(argv[2]);
+    if (benchmark == "lookups") {
+#if !(ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 16))
+        fprintf(stderr, "dataBlockHashIndex needs RocksDB 5.16 or newer\n");
+        return 1;
+#endif
+        benchLookups(path, false);
+        benchLookups(path, true);
+    } else if (benchmark == "commits") {
+#if !(ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 5))
+        fprintf(stderr, "pipelinedWrite needs RocksDB 5.5 or newer\n");
+        return 1;
+#endif
+        benchCommits(path, false);
+        benchCommits(path, true);
+    } else {
+        return usage();
+    }
+    return 0;
+}
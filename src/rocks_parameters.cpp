@@ -30,6 +30,7 @@
 #include "mongo/platform/basic.h"
 
 #include "rocks_parameters.h"
+#include "rocks_global_options.h"
 #include "rocks_util.h"
 
 #include "mongo/logger/parse_log_component_settings.h"
@@ -111,11 +112,89 @@ namespace mongo {
     }
 
     Status RocksCompactServerParameter::set(const BSONElement& newValueElement) {
+        if (newValueElement.type() == String) {
+            return setFromString(newValueElement.str());
+        }
         return setFromString("");
     }
 
     Status RocksCompactServerParameter::setFromString(const std::string& str) {
-        return _engine->getCompactionScheduler()->compactAll();
+        if (str.empty() || str == "1") {
+            return _engine->getCompactionScheduler()->compactAll();
+        }
+        return _engine->compactCollection(str);
+    }
+
+    RocksCancelCompactionParameter::RocksCancelCompactionParameter(RocksEngine* engine)
+        : ServerParameter(ServerParameterSet::getGlobal(), "rocksdbCancelCompaction", false,
+                          true),
+          _engine(engine) {}
+
+    void RocksCancelCompactionParameter::append(OperationContext* opCtx, BSONObjBuilder& b,
+                                                const std::string& name) {
+        b.append(name, "");
+    }
+
+    Status RocksCancelCompactionParameter::set(const BSONElement& newValueElement) {
+        if (newValueElement.isNumber()) {
+            if (newValueElement.safeNumberLong() <= 0) {
+                return Status(ErrorCodes::BadValue,
+                              str::stream() << name() << " has to be a task id or \"all\"");
+            }
+            return _engine->getCompactionScheduler()->cancelCompactionTask(
+                static_cast<uint64_t>(newValueElement.safeNumberLong()));
+        }
+        if (newValueElement.type() != String) {
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << name() << " has to be a task id or \"all\"");
+        }
+        return setFromString(newValueElement.str());
+    }
+
+    Status RocksCancelCompactionParameter::setFromString(const std::string& str) {
+        if (str == "all") {
+            return _engine->getCompactionScheduler()->cancelCompactionTask(0);
+        }
+        long long id = 0;
+        Status status = parseNumberFromString(str, &id);
+        if (!status.isOK() || id <= 0) {
+            return Status(ErrorCodes::BadValue,
+                          str::stream() << name() << " has to be a task id or \"all\"");
+        }
+        return _engine->getCompactionScheduler()->cancelCompactionTask(static_cast<uint64_t>(id));
+    }
+
+    namespace {
+        const char* const kValidateModeNames[] = {"full", "checksum", "fullAndChecksum"};
+    }
+
+    RocksValidateModeParameter::RocksValidateModeParameter()
+        : ServerParameter(ServerParameterSet::getGlobal(), "rocksdbValidateMode", false, true) {}
+
+    void RocksValidateModeParameter::append(OperationContext* opCtx, BSONObjBuilder& b,
+                                            const std::string& name) {
+        b.append(name, kValidateModeNames[rocksGlobalOptions.validateMode.load()]);
+    }
+
+    Status RocksValidateModeParameter::set(const BSONElement& newValueElement) {
+        if (newValueElement.type() != String) {
+            return Status(ErrorCodes::BadValue, str::stream() << name() << " has to be a string");
+        }
+        return setFromString(newValueElement.str());
+    }
+
+    Status RocksValidateModeParameter::setFromString(const std::string& str) {
+        for (int mode = RocksGlobalOptions::kValidateModeFull;
+             mode <= RocksGlobalOptions::kValidateModeFullAndChecksum; ++mode) {
+            if (str == kValidateModeNames[mode]) {
+                log() << "RocksDB: changing validate mode to " << str;
+                rocksGlobalOptions.validateMode.store(mode);
+                return Status::OK();
+            }
+        }
+        return Status(ErrorCodes::BadValue,
+                      str::stream() << name()
+                                    << " has to be \"full\", \"checksum\" or \"fullAndChecksum\"");
     }
 
     RocksCacheSizeParameter::RocksCacheSizeParameter(RocksEngine* engine)
@@ -70,6 +70,10 @@ namespace mongo {
     // We use mongo's setParameter() API to issue a compact request to rocksdb.
     // To compact entire RocksDB instance, call:
     // db.adminCommand({setParameter:1, rocksdbCompact: 1})
+    // To compact a single collection and its indexes, call:
+    // db.adminCommand({setParameter:1, rocksdbCompact: "test.foo"})
+    // Compactions run in the background, their progress is reported in
+    // db.serverStatus().rocksdb.compactions
     class RocksCompactServerParameter : public ServerParameter {
         MONGO_DISALLOW_COPYING(RocksCompactServerParameter);
 
@@ -83,6 +87,37 @@ namespace mongo {
         RocksEngine* _engine;
     };
 
+    // Cancels a compaction listed in db.serverStatus().rocksdb.compactions by its id:
+    // db.adminCommand({setParameter:1, rocksdbCancelCompaction: 3})
+    // or all of them:
+    // db.adminCommand({setParameter:1, rocksdbCancelCompaction: "all"})
+    class RocksCancelCompactionParameter : public ServerParameter {
+        MONGO_DISALLOW_COPYING(RocksCancelCompactionParameter);
+
+    public:
+        RocksCancelCompactionParameter(RocksEngine* engine);
+        virtual void append(OperationContext* opCtx, BSONObjBuilder& b, const std::string& name);
+        virtual Status set(const BSONElement& newValueElement);
+        virtual Status setFromString(const std::string& str);
+
+    private:
+        RocksEngine* _engine;
+    };
+
+    // Switches what validate checks. "full" (the default) scans and decodes all data, "checksum"
+    // only verifies the block checksums of the SST files of each collection and index, without
+    // decoding records or index keys, and "fullAndChecksum" does both:
+    // db.adminCommand({setParameter:1, rocksdbValidateMode: "checksum"})
+    class RocksValidateModeParameter : public ServerParameter {
+        MONGO_DISALLOW_COPYING(RocksValidateModeParameter);
+
+    public:
+        RocksValidateModeParameter();
+        virtual void append(OperationContext* opCtx, BSONObjBuilder& b, const std::string& name);
+        virtual Status set(const BSONElement& newValueElement);
+        virtual Status setFromString(const std::string& str);
+    };
+
     // We use mongo's setParameter() API to dynamically change the size of the block cache
     // To compact entire RocksDB instance, call:
     // db.adminCommand({setParameter:1, rocksdbRuntimeConfigCacheSizeGB: 10})
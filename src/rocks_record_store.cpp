@@ -36,6 +36,8 @@
 #include <mutex>
 #include <memory>
 #include <algorithm>
+#include <deque>
+#include <vector>
 
 #include <boost/thread/locks.hpp>
 
@@ -59,41 +61,42 @@
 #include "mongo/util/concurrency/idle_thread_block.h"
 #include "mongo/util/log.h"
 #include "mongo/util/mongoutils/str.h"
+#include "mongo/util/scopeguard.h"
+#include "mongo/util/time_support.h"
 
 #include "rocks_counter_manager.h"
 #include "rocks_durability_manager.h"
 #include "rocks_compaction_scheduler.h"
 #include "rocks_engine.h"
+#include "rocks_global_options.h"
 #include "rocks_recovery_unit.h"
 #include "rocks_util.h"
+#include "rocks_validate.h"
 
 namespace mongo {
 
     class RocksRecordStore::CappedInsertChange : public RecoveryUnit::Change {
     public:
-        CappedInsertChange(CappedVisibilityManager* cappedVisibilityManager, RocksRecordStore* rs,
+        CappedInsertChange(CappedVisibilityManager* cappedVisibilityManager,
                            SortedRecordIds::iterator it)
-            : _cappedVisibilityManager(cappedVisibilityManager), _rs(rs), _it(it) {}
+            : _cappedVisibilityManager(cappedVisibilityManager), _it(it) {}
 
         virtual void commit() { _cappedVisibilityManager->dealtWithCappedRecord(_it, true); }
 
-        virtual void rollback() {
-            _cappedVisibilityManager->dealtWithCappedRecord(_it, false);
-            stdx::lock_guard<stdx::mutex> lk(_rs->_cappedCallbackMutex);
-            if (_rs->_cappedCallback) {
-                _rs->_cappedCallback->notifyCappedWaitersIfNeeded();
-            }
-        }
+        // notifies the capped waiters if the rollback makes later records visible
+        virtual void rollback() { _cappedVisibilityManager->dealtWithCappedRecord(_it, false); }
 
     private:
         CappedVisibilityManager* _cappedVisibilityManager;
-        RocksRecordStore* const _rs;
         const SortedRecordIds::iterator _it;
     };
 
     CappedVisibilityManager::CappedVisibilityManager(RocksRecordStore* rs,
                                                      RocksDurabilityManager* durabilityManger)
-        : _rs(rs), _oplog_highestSeen(RecordId::min()), _shuttingDown(false) {
+        : _rs(rs),
+          _oplog_highestSeen(RecordId::min()),
+          _shuttingDown(false),
+          _lastVisibilityChangeMicros(0) {
         if (_rs->_isOplog) {
             _oplogJournalThread = stdx::thread(&CappedVisibilityManager::oplogJournalThreadLoop,
                                                this, durabilityManger);
@@ -112,18 +115,49 @@ namespace mongo {
         SortedRecordIds::iterator it =
             _uncommittedRecords.insert(_uncommittedRecords.end(), record);
         opCtx->recoveryUnit()->registerChange(
-            new RocksRecordStore::CappedInsertChange(this, _rs, it));
+            new RocksRecordStore::CappedInsertChange(this, it));
         _oplog_highestSeen = record;
     }
 
     RecordId CappedVisibilityManager::getNextAndAddUncommittedRecord(
         OperationContext* opCtx, std::function<RecordId()> nextId) {
-        stdx::lock_guard<stdx::mutex> lk(_uncommittedRecordIdsMutex);
-        RecordId record = nextId();
-        _addUncommittedRecord_inlock(opCtx, record);
+        RecordId record;
+        getNextAndAddUncommittedRecords(opCtx, [&](size_t count) { return nextId(); }, 1,
+                                        &record);
         return record;
     }
 
+    void CappedVisibilityManager::getNextAndAddUncommittedRecords(
+        OperationContext* opCtx, std::function<RecordId(size_t)> reserveIds, size_t count,
+        RecordId* idsOut) {
+        // All inserts into the collection serialize on the mutex, so we allocate the list nodes
+        // and the changes before taking it. Splicing keeps the iterators valid.
+        SortedRecordIds records(count);
+        std::vector<std::unique_ptr<RecoveryUnit::Change>> changes;
+        changes.reserve(count);
+        for (auto it = records.begin(); it != records.end(); ++it) {
+            changes.emplace_back(new RocksRecordStore::CappedInsertChange(this, it));
+        }
+        int64_t first;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_uncommittedRecordIdsMutex);
+            first = reserveIds(count).repr();
+            dassert(_uncommittedRecords.empty() || _uncommittedRecords.back() < RecordId(first));
+            int64_t next = first;
+            for (auto& record : records) {
+                record = RecordId(next++);
+            }
+            _oplog_highestSeen = records.back();
+            _uncommittedRecords.splice(_uncommittedRecords.end(), records);
+        }
+        // the changes only run when this unit of work ends, so registering them after
+        // publishing the records is fine
+        for (size_t i = 0; i < count; ++i) {
+            idsOut[i] = RecordId(first + static_cast<int64_t>(i));
+            opCtx->recoveryUnit()->registerChange(changes[i].release());
+        }
+    }
+
     void CappedVisibilityManager::oplogJournalThreadLoop(
         RocksDurabilityManager* durabilityManager) try {
         Client::initThread("RocksOplogJournalThread");
@@ -141,21 +175,26 @@ namespace mongo {
 
             decltype(_opsWaitingForJournal) opsAboutToBeJournaled = {};
             _opsWaitingForJournal.swap(opsAboutToBeJournaled);
+            _journalingOps = true;
 
             lk.unlock();
             durabilityManager->waitUntilDurable(/*forceFlush=*/false);
             lk.lock();
 
             for (auto&& op : opsAboutToBeJournaled) {
-                _uncommittedRecords.erase(op);
+                _uncommittedRecords.erase(op.first);
             }
+            _journalingOps = false;
 
+            _lastVisibilityChangeMicros = curTimeMicros64();
             _opsBecameVisibleCV.notify_all();
             lk.unlock();
 
-            stdx::lock_guard<stdx::mutex> cappedCallbackLock(_rs->_cappedCallbackMutex);
-            if (_rs->_cappedCallback) {
-                _rs->_cappedCallback->notifyCappedWaitersIfNeeded();
+            _notifyCappedWaiters();
+            // all of the ops became visible at the same time, so each of them is charged the
+            // wait for the journal from its own commit time
+            for (auto&& op : opsAboutToBeJournaled) {
+                _recordNotifyLatency(op.second);
             }
         }
     } catch (...) {
@@ -179,29 +218,91 @@ namespace mongo {
 
         stdx::unique_lock<stdx::mutex> lk(_uncommittedRecordIdsMutex);
         const auto waitingFor = _oplog_highestSeen;
-        opCtx->waitForConditionOrInterrupt(_opsBecameVisibleCV, lk, [&] {
+        auto isVisible = [&] {
             return _uncommittedRecords.empty() || _uncommittedRecords.front() > waitingFor;
+        };
+        if (isVisible()) {
+            return;
+        }
+        opCtx->waitForConditionOrInterrupt(_opsBecameVisibleCV, lk, isVisible);
+        const unsigned long long now = curTimeMicros64();
+        _wakeupLatencyMicros.record(
+            now > _lastVisibilityChangeMicros ? now - _lastVisibilityChangeMicros : 0);
+    }
+
+    void CappedVisibilityManager::waitForCommittedRecordsToBeVisible(
+        OperationContext* opCtx) const {
+        stdx::unique_lock<stdx::mutex> lk(_uncommittedRecordIdsMutex);
+        opCtx->waitForConditionOrInterrupt(_opsBecameVisibleCV, lk, [&] {
+            return _opsWaitingForJournal.empty() && !_journalingOps;
         });
     }
 
     void CappedVisibilityManager::dealtWithCappedRecord(SortedRecordIds::iterator it, bool didCommit) {
-        stdx::lock_guard<stdx::mutex> lk(_uncommittedRecordIdsMutex);
-        if (didCommit && _rs->_isOplog && *it != _oplog_highestSeen) {
-            // Defer removal from _uncommittedRecordIds until it is durable. We don't need to wait
-            // for durability of ops that didn't commit because they won't become durable.
-            // As an optimization, we only defer visibility until durable if new ops were created
-            // while we were pending. This makes single-threaded w>1 workloads faster and is safe
-            // because durability follows commit order for commits that are fully sequenced (B
-            // doesn't call commit until after A's commit call returns).
-            const bool wasEmpty = _opsWaitingForJournal.empty();
-            _opsWaitingForJournal.push_back(it);
-            if (wasEmpty) {
-                _opsWaitingForJournalCV.notify_one();
+        const unsigned long long commitMicros = curTimeMicros64();
+        bool visibilityMoved = false;
+        {
+            stdx::lock_guard<stdx::mutex> lk(_uncommittedRecordIdsMutex);
+            if (didCommit && _rs->_isOplog && *it != _oplog_highestSeen) {
+                // Defer removal from _uncommittedRecordIds until it is durable. We don't need to
+                // wait for durability of ops that didn't commit because they won't become
+                // durable.
+                // As an optimization, we only defer visibility until durable if new ops were
+                // created while we were pending. This makes single-threaded w>1 workloads faster
+                // and is safe because durability follows commit order for commits that are fully
+                // sequenced (B doesn't call commit until after A's commit call returns).
+                const bool wasEmpty = _opsWaitingForJournal.empty();
+                _opsWaitingForJournal.emplace_back(it, commitMicros);
+                if (wasEmpty) {
+                    _opsWaitingForJournalCV.notify_one();
+                }
+                return;
             }
-        } else {
+            // Records only become visible to readers when the oldest uncommitted record goes
+            // away, so that's the only case in which awaitData cursors have something new to see.
+            // That's the case whether it committed or rolled back and unblocked the ones after it.
+            visibilityMoved = it == _uncommittedRecords.begin();
             _uncommittedRecords.erase(it);
+            if (visibilityMoved) {
+                _lastVisibilityChangeMicros = commitMicros;
+            }
             _opsBecameVisibleCV.notify_all();
         }
+
+        // Wake up the waiters right away instead of leaving them to their await timeout. This
+        // is done outside of _uncommittedRecordIdsMutex since waking up the cursors takes the
+        // notifier's lock
+        if (visibilityMoved) {
+            _notifyCappedWaiters();
+            if (didCommit) {
+                _recordNotifyLatency(commitMicros);
+            }
+        }
+    }
+
+    void CappedVisibilityManager::_notifyCappedWaiters() {
+        stdx::lock_guard<stdx::mutex> cappedCallbackLock(_rs->_cappedCallbackMutex);
+        if (_rs->_cappedCallback) {
+            _rs->_cappedCallback->notifyCappedWaitersIfNeeded();
+        }
+    }
+
+    void CappedVisibilityManager::_recordNotifyLatency(unsigned long long commitMicros) {
+        const unsigned long long now = curTimeMicros64();
+        _notifyLatencyMicros.record(now > commitMicros ? now - commitMicros : 0);
+    }
+
+    void CappedVisibilityManager::appendLatencyStats(BSONObjBuilder* builder) const {
+        {
+            BSONObjBuilder notifyBuilder(builder->subobjStart("commit-to-notify-micros"));
+            _notifyLatencyMicros.appendTo(&notifyBuilder);
+            notifyBuilder.done();
+        }
+        {
+            BSONObjBuilder wakeupBuilder(builder->subobjStart("visible-to-wakeup-micros"));
+            _wakeupLatencyMicros.appendTo(&wakeupBuilder);
+            wakeupBuilder.done();
+        }
     }
 
     bool CappedVisibilityManager::isCappedHidden(const RecordId& record) const {
@@ -358,6 +459,10 @@ namespace mongo {
         }
 
         _hasBackgroundThread = RocksEngine::initRsOplogBackgroundThread(ns);
+        if (!_hasBackgroundThread && _isCapped && _cappedMaxDocs != -1 &&
+            rocksGlobalOptions.cappedMaxDocsSlack > 0) {
+            _hasBackgroundThread = RocksEngine::initRsCappedBackgroundThread(ns, _ident);
+        }
     }
 
     RocksRecordStore::~RocksRecordStore() {
@@ -458,6 +563,16 @@ namespace mongo {
        stdx::unique_lock<stdx::timed_mutex> lock(_cappedDeleterMutex, stdx::defer_lock);
 
         if (_cappedMaxDocs != -1) {
+            const int64_t docsSlack = rocksGlobalOptions.cappedMaxDocsSlack;
+            if (docsSlack > 0 && _hasBackgroundThread) {
+                // Max docs is allowed to overshoot by docsSlack, the background thread brings
+                // the collection back to _cappedMaxDocs. Only delete in the foreground if it
+                // can't keep up.
+                if ((_numRecords.load() + numRecordsDelta - _cappedMaxDocs) <= docsSlack &&
+                    (_dataSize.load() + dataSizeDelta - _cappedMaxSize) < _cappedMaxSizeSlack) {
+                    return 0;
+                }
+            }
             lock.lock(); // Max docs has to be exact, so have to check every time.
         }
         else if(_hasBackgroundThread) {
@@ -659,8 +774,6 @@ namespace mongo {
                                        "object to insert exceeds cappedMaxSize" );
         }
 
-        RocksRecoveryUnit* ru = RocksRecoveryUnit::getRocksRecoveryUnit( opCtx );
-
         RecordId loc;
         if (_isOplog) {
             StatusWith<RecordId> status = oploghack::extractKey(data, len);
@@ -676,6 +789,17 @@ namespace mongo {
             loc = _nextId();
         }
 
+        _insertRecordWithId(opCtx, loc, data, len);
+
+        cappedDeleteAsNeeded(opCtx, loc);
+
+        return StatusWith<RecordId>( loc );
+    }
+
+    void RocksRecordStore::_insertRecordWithId(OperationContext* opCtx, const RecordId& loc,
+                                               const char* data, int len) {
+        RocksRecoveryUnit* ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
+
         // No need to register the write here, since we just allocated a new RecordId so no other
         // transaction can access this key before we commit
         ru->writeBatch()->Put(_cfHandle, _makePrefixedKey(_prefix, loc), rocksdb::Slice(data, len));
@@ -683,12 +807,8 @@ namespace mongo {
             _oplogKeyTracker->insertKey(ru, _cfHandle, loc, len);
         }
 
-        _changeNumRecords( opCtx, 1 );
-        _increaseDataSize( opCtx, len );
-
-        cappedDeleteAsNeeded(opCtx, loc);
-
-        return StatusWith<RecordId>( loc );
+        _changeNumRecords(opCtx, 1);
+        _increaseDataSize(opCtx, len);
     }
 
     Status RocksRecordStore::insertRecordsWithDocWriter(OperationContext* opCtx,
@@ -713,14 +833,48 @@ namespace mongo {
         }
         invariant(pos == (buffer.get() + totalSize));
 
+        if (_isOplog || nDocs == 0) {
+            // oplog RecordIds come from the documents themselves
+            for (size_t i = 0; i < nDocs; ++i) {
+                auto s = insertRecord(opCtx, records[i].data.data(), records[i].data.size(), true);
+                if (!s.isOK())
+                    return s.getStatus();
+                if (idsOut)
+                    idsOut[i] = s.getValue();
+            }
+            return Status::OK();
+        }
+
+        if (_isCapped) {
+            for (size_t i = 0; i < nDocs; ++i) {
+                if (static_cast<int64_t>(records[i].data.size()) > _cappedMaxSize) {
+                    return Status(ErrorCodes::BadValue, "object to insert exceeds cappedMaxSize");
+                }
+            }
+        }
+
+        // Reserve all RecordIds at once, so capped collections take the visibility mutex only
+        // once per batch instead of once per document
+        std::unique_ptr<RecordId[]> ids(new RecordId[nDocs]);
+        if (_isCapped) {
+            _cappedVisibilityManager->getNextAndAddUncommittedRecords(
+                opCtx, [&](size_t count) { return _nextIds(count); }, nDocs, ids.get());
+        } else {
+            const int64_t first = _nextIds(nDocs).repr();
+            for (size_t i = 0; i < nDocs; ++i) {
+                ids[i] = RecordId(first + static_cast<int64_t>(i));
+            }
+        }
+
         for (size_t i = 0; i < nDocs; ++i) {
-            auto s = insertRecord(opCtx, records[i].data.data(), records[i].data.size(), true);
-            if (!s.isOK())
-                return s.getStatus();
+            _insertRecordWithId(opCtx, ids[i], records[i].data.data(), records[i].data.size());
             if (idsOut)
-                idsOut[i] = s.getValue();
+                idsOut[i] = ids[i];
         }
 
+        // Earlier records of this batch are still capped hidden, so one pass covers all of them
+        cappedDeleteAsNeeded(opCtx, ids[nDocs - 1]);
+
         return Status::OK();
     }
 
@@ -783,26 +937,55 @@ namespace mongo {
     }
 
     Status RocksRecordStore::truncate(OperationContext* opCtx) {
-        // We can't use getCursor() here because we need to ignore the visibility of records (i.e.
-        // we need to delete all records, regardless of visibility)
+        // Truncate holds an exclusive lock on the collection, so nobody else can be writing to our
+        // prefix. Instead of reading and deleting every record (and registering every key with the
+        // transaction engine) we drop the whole key range at once, the same way dropped prefixes
+        // are handled by the engine.
+        _waitForHiddenCommittedRecords(opCtx);
         auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
-        std::unique_ptr<RocksIterator> iterator(ru->NewIterator(_cfHandle, _prefix, _isOplog));
-        for (iterator->SeekToFirst(); iterator->Valid(); iterator->Next()) {
-            deleteRecord(opCtx, _makeRecordId(iterator->key()));
+        // don't delete the <prefix> key that the engine writes when creating the ident
+        const std::string beginKey(_prefix + '\0');
+        ru->deleteRange(_cfHandle, beginKey, rocksGetNextPrefix(_prefix));
+        if (_isOplog) {
+            const std::string oplogKeyTrackerPrefix(rocksGetNextPrefix(_prefix));
+            ru->deleteRange(_cfHandle, oplogKeyTrackerPrefix + '\0',
+                            rocksGetNextPrefix(oplogKeyTrackerPrefix));
         }
 
-        return rocksToMongoStatus(iterator->status());
+        // counters are adjusted from what we know instead of from the deleted data
+        _changeNumRecords(opCtx, -numRecords(opCtx));
+        _increaseDataSize(opCtx, -dataSize(opCtx));
+
+        return Status::OK();
     }
 
     Status RocksRecordStore::compact( OperationContext* opCtx,
                                       RecordStoreCompactAdaptor* adaptor,
                                       const CompactOptions* options,
                                       CompactStats* stats ) {
-        std::string beginString(_makePrefixedKey(_prefix, RecordId()));
-        std::string endString(_makePrefixedKey(_prefix, RecordId::max()));
-        rocksdb::Slice beginRange(beginString);
-        rocksdb::Slice endRange(endString);
-        return rocksToMongoStatus(_db->CompactRange(_cfHandle, &beginRange, &endRange));
+        if (!_compactionScheduler) {
+            const std::string end(_compactionEnd());
+            rocksdb::Slice beginRange(_prefix);
+            rocksdb::Slice endRange(end);
+            return rocksToMongoStatus(_db->CompactRange(rocksdb::CompactRangeOptions(), _cfHandle,
+                                                        &beginRange, &endRange));
+        }
+        return _compactionScheduler->waitForCompaction(opCtx, scheduleCompaction());
+    }
+
+    std::shared_ptr<RocksCompactionTask> RocksRecordStore::scheduleCompaction() {
+        invariant(_compactionScheduler);
+        return _compactionScheduler->compactRangeTask("collection " + _ns, _cfHandle, _prefix,
+                                                      _compactionEnd());
+    }
+
+    std::string RocksRecordStore::_compactionEnd() const {
+        std::string end(rocksGetNextPrefix(_prefix));
+        if (_isOplog) {
+            // oplog key tracker uses the next prefix
+            end = rocksGetNextPrefix(end);
+        }
+        return end;
     }
 
     Status RocksRecordStore::validate( OperationContext* opCtx,
@@ -810,24 +993,45 @@ namespace mongo {
                                        ValidateAdaptor* adaptor,
                                        ValidateResults* results,
                                        BSONObjBuilder* output ) {
+        const int validateMode = rocksGlobalOptions.validateMode.load();
+        if (validateMode == RocksGlobalOptions::kValidateModeChecksum) {
+            // block-level integrity only, no record is read or decoded
+            results->valid = true;
+            Status status = _validateChecksums(results, output);
+            if (!status.isOK()) {
+                return status;
+            }
+            output->appendNumber("nrecords", numRecords(opCtx));
+            return Status::OK();
+        }
+
         long long nrecords = 0;
         long long dataSizeTotal = 0;
         if (level == kValidateRecordStore || level == kValidateFull) {
-            auto cursor = getCursor(opCtx, true);
             results->valid = true;
-            const int interruptInterval = 4096;
-            while (auto record = cursor->next()) {
-                if (!(nrecords % interruptInterval))
-                    opCtx->checkForInterrupt();
-                ++nrecords;
-                if (level == kValidateFull) {
-                    size_t dataSize;
-                    Status status = adaptor->validate(record->id, record->data, &dataSize);
-                    if (!status.isOK()) {
-                        results->valid = false;
-                        results->errors.push_back(str::stream() << record->id << " is corrupted");
+            if (rocksGlobalOptions.validateThreads > 1 && !_isOplog) {
+                Status status = _validateParallel(opCtx, level, adaptor, results, &nrecords,
+                                                  &dataSizeTotal);
+                if (!status.isOK()) {
+                    return status;
+                }
+            } else {
+                auto cursor = getCursor(opCtx, true);
+                const int interruptInterval = 4096;
+                while (auto record = cursor->next()) {
+                    if (!(nrecords % interruptInterval))
+                        opCtx->checkForInterrupt();
+                    ++nrecords;
+                    if (level == kValidateFull) {
+                        size_t dataSize;
+                        Status status = adaptor->validate(record->id, record->data, &dataSize);
+                        if (!status.isOK()) {
+                            results->valid = false;
+                            results->errors.push_back(str::stream() << record->id
+                                                                    << " is corrupted");
+                        }
+                        dataSizeTotal += static_cast<long long>(dataSize);
                     }
-                    dataSizeTotal += static_cast<long long>(dataSize);
                 }
             }
 
@@ -852,6 +1056,146 @@ namespace mongo {
             output->appendNumber("nrecords", numRecords(opCtx));
         }
 
+        if (level == kValidateFull &&
+            validateMode == RocksGlobalOptions::kValidateModeFullAndChecksum) {
+            Status status = _validateChecksums(results, output);
+            if (!status.isOK()) {
+                results->warnings.push_back(str::stream() << "SST checksums not verified: "
+                                                          << status.reason());
+            }
+        }
+
+        return Status::OK();
+    }
+
+    Status RocksRecordStore::_validateParallel(OperationContext* opCtx, ValidateCmdLevel level,
+                                               ValidateAdaptor* adaptor,
+                                               ValidateResults* results, long long* nrecords,
+                                               long long* dataSizeTotal) {
+        const size_t numThreads = rocksGlobalOptions.validateThreads;
+        const bool validateRecords = level == kValidateFull;
+        // each thread counts the records of its range, we sum them up at the end
+        std::vector<long long> rangeRecords(numThreads, 0);
+
+        // The adaptor isn't thread safe, so the scanning threads hand the records over to this
+        // thread in batches. They keep reading and decompressing while we validate.
+        typedef std::vector<std::pair<RecordId, std::string>> Batch;
+        const size_t kBatchSize = 256;
+        const size_t kMaxQueuedBatches = 2 * numThreads;
+        std::vector<Batch> rangeBatches(numThreads);
+        stdx::mutex queueMutex;
+        stdx::condition_variable queueCV;
+        // protected by queueMutex
+        std::deque<Batch> queue;
+        bool stopped = false;
+
+        auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
+        // skip the <prefix> key the engine adds when creating the ident
+        std::string begin(_prefix);
+        begin.push_back('\0');
+        RocksParallelScan scan(
+            _db, _cfHandle, ru->snapshot(), begin, rocksGetNextPrefix(_prefix), numThreads,
+            [&](size_t range, const rocksdb::Slice& key, const rocksdb::Slice& value) {
+                ++rangeRecords[range];
+                if (!validateRecords) {
+                    return;
+                }
+                Batch& batch = rangeBatches[range];
+                batch.emplace_back(
+                    _makeRecordId(rocksdb::Slice(key.data() + _prefix.size(),
+                                                 key.size() - _prefix.size())),
+                    value.ToString());
+                if (batch.size() < kBatchSize) {
+                    return;
+                }
+                stdx::unique_lock<stdx::mutex> lk(queueMutex);
+                queueCV.wait(lk, [&] { return stopped || queue.size() < kMaxQueuedBatches; });
+                if (!stopped) {
+                    queue.push_back(std::move(batch));
+                    queueCV.notify_all();
+                }
+                batch.clear();
+            });
+        // Runs before the scan's destructor joins the threads, so none of them is stuck waiting
+        // for room in the queue
+        ON_BLOCK_EXIT([&] {
+            stdx::lock_guard<stdx::mutex> lk(queueMutex);
+            stopped = true;
+            queueCV.notify_all();
+        });
+
+        long long dataSize = 0;
+        auto validateBatch = [&](const Batch& batch) {
+            for (const auto& record : batch) {
+                size_t recordDataSize;
+                Status s = adaptor->validate(
+                    record.first, RecordData(record.second.data(), record.second.size()),
+                    &recordDataSize);
+                if (!s.isOK()) {
+                    results->valid = false;
+                    results->errors.push_back(str::stream() << record.first << " is corrupted");
+                }
+                dataSize += static_cast<long long>(recordDataSize);
+            }
+        };
+
+        while (true) {
+            // once the scan is done, nothing gets added to the queue anymore
+            const bool scanDone = scan.waitFor(stdx::chrono::milliseconds(0));
+            Batch batch;
+            {
+                stdx::unique_lock<stdx::mutex> lk(queueMutex);
+                if (!scanDone) {
+                    queueCV.wait_for(lk, stdx::chrono::milliseconds(100),
+                                     [&] { return !queue.empty(); });
+                }
+                if (queue.empty() && scanDone) {
+                    break;
+                }
+                if (!queue.empty()) {
+                    batch = std::move(queue.front());
+                    queue.pop_front();
+                    queueCV.notify_all();
+                }
+            }
+            validateBatch(batch);
+            Status interruptStatus = opCtx->checkForInterruptNoAssert();
+            if (!interruptStatus.isOK()) {
+                return interruptStatus;
+            }
+        }
+
+        Status status = scan.getStatus();
+        if (!status.isOK()) {
+            return status;
+        }
+        // what's left of each range didn't fill a batch
+        for (const auto& batch : rangeBatches) {
+            validateBatch(batch);
+        }
+
+        *nrecords = 0;
+        for (long long records : rangeRecords) {
+            *nrecords += records;
+        }
+        *dataSizeTotal = dataSize;
+        return Status::OK();
+    }
+
+    Status RocksRecordStore::_validateChecksums(ValidateResults* results,
+                                                BSONObjBuilder* output) {
+        long long numFiles = 0;
+        Status status =
+            rocksVerifySstChecksumsInRange(_db, _cfHandle, _prefix, _compactionEnd(), &numFiles);
+        if (status.code() == ErrorCodes::CommandNotSupported) {
+            return status;
+        }
+        if (!status.isOK()) {
+            results->valid = false;
+            results->errors.push_back(str::stream() << "SST checksum verification failed: "
+                                                    << status.reason());
+        }
+        output->appendNumber("sstFilesVerified", numFiles);
         return Status::OK();
     }
 
@@ -862,6 +1206,9 @@ namespace mongo {
         if (_isCapped) {
             result->appendIntOrLL("max", _cappedMaxDocs);
             result->appendIntOrLL("maxSize", _cappedMaxSize / scale);
+            BSONObjBuilder visibilityBuilder(result->subobjStart("visibility-latency"));
+            _cappedVisibilityManager->appendLatencyStats(&visibilityBuilder);
+            visibilityBuilder.done();
         }
     }
 
@@ -912,30 +1259,8 @@ namespace mongo {
         // need keys (we never touch the values), so this works nicely
         std::unique_ptr<rocksdb::Iterator> iter(_oplogKeyTracker->newIterator(ru, _cfHandle));
         int64_t storage;
-        iter->Seek(_makeKey(startingPosition, &storage));
-        if (!iter->Valid()) {
-            iter->SeekToLast();
-            if (iter->Valid()) {
-                // startingPosition is bigger than everything else
-                return _makeRecordId(iter->key());
-            } else {
-                invariantRocksOK(iter->status());
-                // record store is empty
-                return RecordId();
-            }
-        }
-
-        // We're at or past target:
-        // 1) if we're at -- return
-        // 2) if we're past -- do a prev()
-        RecordId foundKey = _makeRecordId(iter->key());
-        int cmp = startingPosition.compare(foundKey);
-        if (cmp != 0) {
-            // RocksDB invariant -- iterator needs to land at or past target when Seek-ing
-            invariant(cmp < 0);
-            // we're past target -- prev()
-            iter->Prev();
-        }
+        // lands on the last entry <= startingPosition
+        iter->SeekForPrev(_makeKey(startingPosition, &storage));
 
         if (!iter->Valid()) {
             invariantRocksOK(iter->status());
@@ -948,10 +1273,16 @@ namespace mongo {
 
     void RocksRecordStore::cappedTruncateAfter(OperationContext* opCtx, RecordId end,
                                                bool inclusive) {
-        // copied from WiredTigerRecordStore::cappedTruncateAfter()
+        // Callers hold an exclusive lock on the collection, so we can remove everything after
+        // `end` with a single range deletion. We still need one pass over the doomed records to
+        // adjust the counters and to hand them to the capped callback. Without a callback the
+        // oplog can make that a key-only pass over _oplogKeyTracker.
+        _waitForHiddenCommittedRecords(opCtx);
         WriteUnitOfWork wuow(opCtx);
+        auto ru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
         RecordId lastKeptId = end;
         int64_t recordsRemoved = 0;
+        int64_t sizeRemoved = 0;
 
         if (inclusive) {
             auto reverseCursor = getCursor(opCtx, false);
@@ -960,23 +1291,46 @@ namespace mongo {
             lastKeptId = prev ? prev->id : RecordId::min();
         }
 
+        const RecordId firstRemovedId = inclusive ? end : RecordId(end.repr() + 1);
+        int64_t storage;
         {
-            auto cursor = getCursor(opCtx, true);
             stdx::lock_guard<stdx::mutex> lk(_cappedCallbackMutex);
-
-            for (auto record = cursor->seekExact(end); record; record = cursor->next()) {
-                if (end < record->id || (inclusive && end == record->id)) {
+            // the callback gets the real documents, so only skip reading them when there's none
+            const bool keysOnly = _isOplog && !_cappedCallback;
+            std::unique_ptr<rocksdb::Iterator> iter;
+            if (keysOnly) {
+                iter.reset(_oplogKeyTracker->newIterator(ru, _cfHandle));
+            } else {
+                iter.reset(ru->NewIterator(_cfHandle, _prefix, _isOplog));
+            }
+            for (iter->Seek(_makeKey(firstRemovedId, &storage)); iter->Valid(); iter->Next()) {
+                if (keysOnly) {
+                    sizeRemoved += _oplogKeyTracker->decodeSize(iter->value());
+                } else {
+                    const rocksdb::Slice data = iter->value();
+                    sizeRemoved += data.size();
                     if (_cappedCallback) {
-                        uassertStatusOK(
-                            _cappedCallback->aboutToDeleteCapped(opCtx, record->id, record->data));
+                        uassertStatusOK(_cappedCallback->aboutToDeleteCapped(
+                            opCtx, _makeRecordId(iter->key()),
+                            RecordData(data.data(), data.size())));
                     }
-                    deleteRecord(opCtx, record->id);
-                    ++recordsRemoved;
                 }
+                ++recordsRemoved;
             }
+            invariantRocksOK(iter->status());
         }
 
         if (recordsRemoved) {
+            std::string beginKey(_makePrefixedKey(_prefix, firstRemovedId));
+            ru->deleteRange(_cfHandle, beginKey, rocksGetNextPrefix(_prefix));
+            if (_isOplog) {
+                const std::string oplogKeyTrackerPrefix(rocksGetNextPrefix(_prefix));
+                beginKey = _makePrefixedKey(oplogKeyTrackerPrefix, firstRemovedId);
+                ru->deleteRange(_cfHandle, beginKey, rocksGetNextPrefix(oplogKeyTrackerPrefix));
+            }
+            _changeNumRecords(opCtx, -recordsRemoved);
+            _increaseDataSize(opCtx, -sizeRemoved);
+
             // Forget that we've ever seen a higher timestamp than we now have.
             _cappedVisibilityManager->setHighestSeen(lastKeptId);
         }
@@ -984,11 +1338,29 @@ namespace mongo {
         wuow.commit();
     }
 
+    void RocksRecordStore::_waitForHiddenCommittedRecords(OperationContext* opCtx) {
+        if (!_cappedVisibilityManager) {
+            return;
+        }
+        // Committed oplog records stay hidden in _uncommittedRecords until the journal thread
+        // sees them synced. A range deletion would remove them underneath it, and their ids
+        // would hide the records written after the truncation, so let them become visible
+        // first. With the collection locked exclusively, all that's left hidden afterwards are
+        // our own uncommitted records, which the range deletion removes from our write batch
+        // and which leave _uncommittedRecords when we commit or roll back.
+        _cappedVisibilityManager->waitForCommittedRecordsToBeVisible(opCtx);
+    }
+
     RecordId RocksRecordStore::_nextId() {
         invariant(!_isOplog);
         return RecordId(_nextIdNum.fetchAndAdd(1));
     }
 
+    RecordId RocksRecordStore::_nextIds(size_t count) {
+        invariant(!_isOplog);
+        return RecordId(_nextIdNum.fetchAndAdd(count));
+    }
+
     rocksdb::Slice RocksRecordStore::_makeKey(const RecordId& loc, int64_t* storage) {
         *storage = endian::nativeToBig(loc.repr());
         return rocksdb::Slice(reinterpret_cast<const char*>(storage), sizeof(*storage));
@@ -1071,33 +1443,17 @@ namespace mongo {
     void RocksRecordStore::Cursor::positionIterator() {
         _skipNextAdvance = false;
         int64_t locStorage;
-        _iterator->Seek(RocksRecordStore::_makeKey(_lastLoc, &locStorage));
-        invariantRocksOK(_iterator->status());
-
+        // Forward cursors land on or after the key, reverse cursors on or before it
         if (_forward) {
-            // If _skipNextAdvance is true we landed after where we were. Return our new location on
-            // the next call to next().
-            _skipNextAdvance =
-                !_iterator->Valid() || _lastLoc != _makeRecordId(_iterator->key());
-        }
-        else {
-            // Seek() lands on or after the key, while reverse cursors need to land on or before.
-            if (!_iterator->Valid()) {
-                // Nothing left on or after.
-                _iterator->SeekToLast();
-                invariantRocksOK(_iterator->status());
-                _skipNextAdvance = true;
-            }
-            else {
-                if (_lastLoc != _makeRecordId(_iterator->key())) {
-                    // Landed after. This is true: iterator->key() > _lastLoc
-                    // Since iterator is valid and Seek() landed after key,
-                    // iterator will still be valid after we call Prev().
-                    _skipNextAdvance = true;
-                    _iterator->Prev();
-                }
-            }
+            _iterator->Seek(RocksRecordStore::_makeKey(_lastLoc, &locStorage));
+        } else {
+            _iterator->SeekForPrev(RocksRecordStore::_makeKey(_lastLoc, &locStorage));
         }
+        invariantRocksOK(_iterator->status());
+
+        // If _skipNextAdvance is true we landed past where we were. Return our new location on
+        // the next call to next().
+        _skipNextAdvance = !_iterator->Valid() || _lastLoc != _makeRecordId(_iterator->key());
         // _lastLoc != _makeRecordId(_iterator->key()) indicates that the record _lastLoc was
         // deleted. In this case, mark _eof only if the collection is capped.
         _eof = !_iterator->Valid() || (_isCapped && _lastLoc != _makeRecordId(_iterator->key()));
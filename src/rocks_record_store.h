@@ -48,6 +48,8 @@
 #include "mongo/stdx/thread.h"
 #include "mongo/util/timer.h"
 
+#include "rocks_histogram.h"
+
 namespace rocksdb {
     class ColumnFamilyHandle;
     class DB;
@@ -60,6 +62,7 @@ namespace mongo {
     class RocksCounterManager;
     class RocksDurabilityManager;
     class RocksCompactionScheduler;
+    class RocksCompactionTask;
     class RocksRecoveryUnit;
     class RocksOplogKeyTracker;
     class RocksRecordStore;
@@ -78,18 +81,40 @@ namespace mongo {
         RecordId getNextAndAddUncommittedRecord(OperationContext* opCtx,
                                                 std::function<RecordId()> nextId);
 
+        // Same as above, but reserves 'count' consecutive records while holding the visibility
+        // mutex only once. reserveIds(count) has to return the first of 'count' consecutive ids.
+        void getNextAndAddUncommittedRecords(OperationContext* opCtx,
+                                             std::function<RecordId(size_t)> reserveIds,
+                                             size_t count, RecordId* idsOut);
+
         bool isCappedHidden(const RecordId& record) const;
         RecordId oplogStartHack() const;
 
         RecordId lowestCappedHiddenRecord() const;
 
         void waitForAllEarlierOplogWritesToBeVisible(OperationContext* opCtx) const;
+        // Waits until the records that committed but wait for the journal are visible. Doesn't
+        // wait for uncommitted records.
+        void waitForCommittedRecordsToBeVisible(OperationContext* opCtx) const;
         void oplogJournalThreadLoop(RocksDurabilityManager* durabilityManager);
         void joinOplogJournalThreadLoop();
 
+        // Appends the latency histograms of this collection: from the commit that makes records
+        // visible until awaitData cursors are notified, and from records becoming visible until
+        // waitForAllEarlierOplogWritesToBeVisible() callers that had to wait wake up. The
+        // awaitData cursors themselves wake up in the server's notifier, outside of our view.
+        void appendLatencyStats(BSONObjBuilder* builder) const;
+
     private:
         void _addUncommittedRecord_inlock(OperationContext* opCtx, const RecordId& record);
 
+        // Wakes up awaitData cursors waiting on this collection
+        void _notifyCappedWaiters();
+
+        // Records how long it took from the commit that made records visible until the waiters
+        // were notified
+        void _recordNotifyLatency(unsigned long long commitMicros);
+
         // protects the state
         mutable stdx::mutex _uncommittedRecordIdsMutex;
         RocksRecordStore* const _rs;
@@ -100,8 +125,17 @@ namespace mongo {
         // These use the _uncommittedRecordIdsMutex and are only used when _isOplog is true.
         stdx::condition_variable _opsWaitingForJournalCV;
         mutable stdx::condition_variable _opsBecameVisibleCV;
-        std::vector<SortedRecordIds::iterator> _opsWaitingForJournal;
+        // {record, time of commit in micros}
+        std::vector<std::pair<SortedRecordIds::iterator, unsigned long long>>
+            _opsWaitingForJournal;
+        // true while the journal thread waits for the ops it took from _opsWaitingForJournal
+        bool _journalingOps = false;
         stdx::thread _oplogJournalThread;
+        // when the visible range last moved, protected by _uncommittedRecordIdsMutex
+        unsigned long long _lastVisibilityChangeMicros;
+
+        RocksHistogram _notifyLatencyMicros;
+        mutable RocksHistogram _wakeupLatencyMicros;
     };
 
     class RocksRecordStore : public RecordStore {
@@ -173,6 +207,9 @@ namespace mongo {
                                 const CompactOptions* options,
                                 CompactStats* stats );
 
+        // Schedules a compaction of the whole collection without waiting for it
+        std::shared_ptr<RocksCompactionTask> scheduleCompaction();
+
         virtual Status validate( OperationContext* opCtx,
                                  ValidateCmdLevel level,
                                  ValidateAdaptor* adaptor,
@@ -199,6 +236,7 @@ namespace mongo {
           _cappedCallback = cb;
         }
         int64_t cappedMaxDocs() const { invariant(_isCapped); return _cappedMaxDocs; }
+        const std::string& getIdent() const { return _ident; }
         int64_t cappedMaxSize() const { invariant(_isCapped); return _cappedMaxSize; }
         bool isOplog() const { return _isOplog; }
 
@@ -269,13 +307,33 @@ namespace mongo {
                                       const std::string& prefix,
                                       OperationContext* opCtx, const RecordId& loc);
 
+        // Makes sure no committed record is hidden before a range deletion
+        void _waitForHiddenCommittedRecords(OperationContext* opCtx);
+
         RecordId _nextId();
+        // returns the first of 'count' consecutive newly allocated RecordIds
+        RecordId _nextIds(size_t count);
         bool cappedAndNeedDelete(long long dataSizeDelta, long long numRecordsDelta) const;
 
         // The use of this function requires that the passed in storage outlives the returned Slice
         static rocksdb::Slice _makeKey(const RecordId& loc, int64_t* storage);
         static std::string _makePrefixedKey(const std::string& prefix, const RecordId& loc);
 
+        // Writes a record under an already allocated RecordId and accounts for it
+        void _insertRecordWithId(OperationContext* opCtx, const RecordId& loc, const char* data,
+                                 int len);
+
+        // End of the key range that compact(), scheduleCompaction() and validate cover
+        std::string _compactionEnd() const;
+
+        // Scans the record store with rocksGlobalOptions.validateThreads threads
+        Status _validateParallel(OperationContext* opCtx, ValidateCmdLevel level,
+                                 ValidateAdaptor* adaptor, ValidateResults* results,
+                                 long long* nrecords, long long* dataSizeTotal);
+        // Verifies the block checksums of the SST files holding the record store. Returns
+        // CommandNotSupported if RocksDB can't verify them, corruption goes into results.
+        Status _validateChecksums(ValidateResults* results, BSONObjBuilder* output);
+
         void _changeNumRecords(OperationContext* opCtx, int64_t amount);
         void _increaseDataSize(OperationContext* opCtx, int64_t amount);
 
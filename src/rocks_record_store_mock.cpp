@@ -44,6 +44,11 @@ bool RocksEngine::initRsOplogBackgroundThread(StringData ns) {
     return NamespaceString::oplog(ns);
 }
 
+// static
+bool RocksEngine::initRsCappedBackgroundThread(StringData ns, StringData ident) {
+    return false;
+}
+
 MONGO_INITIALIZER(SetGlobalEnvironment)(InitializerContext* context) {
     setGlobalServiceContext(stdx::make_unique<ServiceContextNoop>());
     return Status::OK();
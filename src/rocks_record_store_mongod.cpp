@@ -31,7 +31,7 @@
 
 #include "mongo/platform/basic.h"
 
-#include <set>
+#include <map>
 #include <mutex>
 
 #include "mongo/base/checked_cast.h"
@@ -55,13 +55,22 @@ namespace mongo {
 
     namespace {
 
-        std::set<NamespaceString> _backgroundThreadNamespaces;
+        class RocksRecordStoreThread;
+
+        // the oplog threads are keyed by namespace, the capped ones by the ident of the record
+        // store they serve, since a dropped collection's thread can outlive it for a bit and a
+        // renamed collection keeps its ident. Threads remove themselves before they exit.
+        std::map<std::string, RocksRecordStoreThread*> _backgroundThreads;
         stdx::mutex _backgroundThreadMutex;
 
         class RocksRecordStoreThread : public BackgroundJob {
         public:
-            RocksRecordStoreThread(const NamespaceString& ns)
-                : BackgroundJob(true /* deleteSelf */), _ns(ns) {
+            RocksRecordStoreThread(const NamespaceString& ns, std::string ident)
+                : BackgroundJob(true /* deleteSelf */),
+                  _ns(ns),
+                  _ident(std::move(ident)),
+                  _exitWhenDropped(!_ident.empty()),
+                  _seenCollection(false) {
                 _name = std::string("RocksRecordStoreThread for ") + _ns.toString();
             }
 
@@ -69,10 +78,19 @@ namespace mongo {
                 return _name;
             }
 
+            // Follows a rename of the collection. Requires _backgroundThreadMutex.
+            void setNs_inlock(const NamespaceString& ns) {
+                if (ns != _ns) {
+                    log() << "RocksRecordStoreThread for " << _ns << " now serves " << ns;
+                    _ns = ns;
+                }
+            }
+
             /**
-             * @return Number of documents deleted.
+             * @return Number of documents deleted, or -1 if the thread should exit because the
+             * collection it serves is gone.
              */
-            int64_t _deleteExcessDocuments() {
+            int64_t _deleteExcessDocuments(const NamespaceString& ns) {
                 if (!getGlobalServiceContext()->getGlobalStorageEngine()) {
                     LOG(1) << "no global storage engine yet";
                     return 0;
@@ -81,23 +99,31 @@ namespace mongo {
                 const auto opCtx = cc().makeOperationContext();
 
                 try {
-                    AutoGetDb autoDb(opCtx.get(), _ns.db(), MODE_IX);
+                    AutoGetDb autoDb(opCtx.get(), ns.db(), MODE_IX);
                     Database* db = autoDb.getDb();
                     if (!db) {
                         LOG(2) << "no local database yet";
                         return 0;
                     }
 
-                    Lock::CollectionLock collectionLock(opCtx->lockState(), _ns.ns(), MODE_IX);
-                    Collection* collection = db->getCollection(opCtx.get(), _ns);
+                    Lock::CollectionLock collectionLock(opCtx->lockState(), ns.ns(), MODE_IX);
+                    Collection* collection = db->getCollection(opCtx.get(), ns);
                     if (!collection) {
-                        LOG(2) << "no collection " << _ns;
-                        return 0;
+                        LOG(2) << "no collection " << ns;
+                        // the record store is created before the collection is registered, so
+                        // only give up on collections we've seen before
+                        return (_exitWhenDropped && _seenCollection) ? -1 : 0;
                     }
+                    _seenCollection = true;
 
-                    OldClientContext ctx(opCtx.get(), _ns.ns(), false);
+                    OldClientContext ctx(opCtx.get(), ns.ns(), false);
                     RocksRecordStore* rs =
                         checked_cast<RocksRecordStore*>(collection->getRecordStore());
+                    if (_exitWhenDropped && rs->getIdent() != _ident) {
+                        // collection was dropped and recreated, the new record store has its
+                        // own thread if it needs one
+                        return -1;
+                    }
                     WriteUnitOfWork wuow(opCtx.get());
                     stdx::lock_guard<stdx::timed_mutex> lock(rs->cappedDeleterMutex());
                     int64_t removed = rs->cappedDeleteAsNeeded_inlock(opCtx.get(), RecordId::max());
@@ -117,7 +143,22 @@ namespace mongo {
                 Client::initThread(_name.c_str());
 
                 while (!globalInShutdownDeprecated()) {
-                    int64_t removed = _deleteExcessDocuments();
+                    NamespaceString ns;
+                    {
+                        stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
+                        ns = _ns;
+                    }
+                    int64_t removed = _deleteExcessDocuments(ns);
+                    if (removed < 0) {
+                        stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
+                        if (ns != _ns) {
+                            // renamed while we looked for it, try the new name
+                            continue;
+                        }
+                        _backgroundThreads.erase(_key());
+                        log() << "collection " << _ns << " is gone, exiting";
+                        return;
+                    }
                     LOG(2) << "RocksRecordStoreThread deleted " << removed;
                     if (removed == 0) {
                         // If we removed 0 documents, sleep a bit in case we're on a laptop
@@ -133,10 +174,44 @@ namespace mongo {
             }
 
         private:
+            const std::string& _key() const {
+                return _exitWhenDropped ? _ident : _ns.ns();
+            }
+
+            // protected by _backgroundThreadMutex
             NamespaceString _ns;
+            // empty for the oplog
+            const std::string _ident;
             std::string _name;
+            // capped collections other than the oplog can be dropped while we run
+            const bool _exitWhenDropped;
+            bool _seenCollection;
         };
 
+        bool startBackgroundThread(const NamespaceString& nss, std::string ident) {
+            if (storageGlobalParams.repair) {
+                LOG(1) << "not starting RocksRecordStoreThread for " << nss
+                       << " because we are in repair";
+                return false;
+            }
+
+            const std::string key = ident.empty() ? nss.ns() : ident;
+            stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
+            auto it = _backgroundThreads.find(key);
+            if (it != _backgroundThreads.end()) {
+                log() << "RocksRecordStoreThread " << nss << " already started";
+                // renaming a collection opens its record store again under the new name
+                it->second->setNs_inlock(nss);
+            }
+            else {
+                log() << "Starting RocksRecordStoreThread " << nss;
+                auto backgroundThread = new RocksRecordStoreThread(nss, std::move(ident));
+                backgroundThread->go();
+                _backgroundThreads[key] = backgroundThread;
+            }
+            return true;
+        }
+
     }  // namespace
 
     // static
@@ -145,24 +220,16 @@ namespace mongo {
             return false;
         }
 
-        if (storageGlobalParams.repair) {
-            LOG(1) << "not starting RocksRecordStoreThread for " << ns
-                   << " because we are in repair";
+        return startBackgroundThread(NamespaceString(ns), std::string());
+    }
+
+    // static
+    bool RocksEngine::initRsCappedBackgroundThread(StringData ns, StringData ident) {
+        if (NamespaceString::oplog(ns)) {
             return false;
         }
 
-        stdx::lock_guard<stdx::mutex> lock(_backgroundThreadMutex);
-        NamespaceString nss(ns);
-        if (_backgroundThreadNamespaces.count(nss)) {
-            log() << "RocksRecordStoreThread " << ns << " already started";
-        }
-        else {
-            log() << "Starting RocksRecordStoreThread " << ns;
-            BackgroundJob* backgroundThread = new RocksRecordStoreThread(nss);
-            backgroundThread->go();
-            _backgroundThreadNamespaces.insert(nss);
-        }
-        return true;
+        return startBackgroundThread(NamespaceString(ns), ident.toString());
     }
 
 }  // namespace mongo
@@ -37,13 +37,18 @@
 #include <rocksdb/options.h>
 #include <rocksdb/slice.h>
 
+#include "mongo/base/checked_cast.h"
 #include "mongo/base/init.h"
+#include "mongo/bson/bsonobjbuilder.h"
 #include "mongo/db/concurrency/write_conflict_exception.h"
 #include "mongo/db/storage/record_store_test_harness.h"
 #include "mongo/unittest/unittest.h"
 #include "mongo/unittest/temp_dir.h"
+#include "mongo/util/scopeguard.h"
+#include "mongo/util/time_support.h"
 
 #include "rocks_compaction_scheduler.h"
+#include "rocks_global_options.h"
 #include "rocks_record_store.h"
 #include "rocks_recovery_unit.h"
 #include "rocks_transaction.h"
@@ -102,6 +107,16 @@ namespace mongo {
           return true;
         }
 
+        // writes the memtable out to an SST file
+        void flush() {
+            auto s = _db->Flush(rocksdb::FlushOptions());
+            ASSERT(s.ok());
+        }
+
+        RocksCompactionScheduler* getCompactionScheduler() { return _compactionScheduler.get(); }
+
+        RocksDurabilityManager* getDurabilityManager() { return _durabilityManager.get(); }
+
     private:
         string _testNamespace = "mongo-rocks-record-store-test";
         unittest::TempDir _tempDir;
@@ -461,6 +476,525 @@ namespace mongo {
         }
     }
 
+    TEST(RocksRecordStoreTest, TruncateWithinUnitOfWork) {
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+                new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newNonCappedRecordStore());
+
+        RecordId loc1;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            StatusWith<RecordId> res = rs->insertRecord(opCtx.get(), "a", 2, false);
+            ASSERT_OK(res.getStatus());
+            loc1 = res.getValue();
+            uow.commit();
+        }
+
+        RecordId loc3;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            StatusWith<RecordId> res = rs->insertRecord(opCtx.get(), "b", 2, false);
+            ASSERT_OK(res.getStatus());
+            RecordId loc2 = res.getValue();
+
+            ASSERT_OK(rs->truncate(opCtx.get()));
+            ASSERT_EQ(0, rs->numRecords(opCtx.get()));
+            ASSERT_EQ(0, rs->dataSize(opCtx.get()));
+
+            // neither the committed nor our own uncommitted record is visible anymore
+            auto cursor = rs->getCursor(opCtx.get());
+            ASSERT(!cursor->seekExact(loc1));
+            ASSERT(!cursor->seekExact(loc2));
+
+            // but records written after the truncate are
+            res = rs->insertRecord(opCtx.get(), "c", 2, false);
+            ASSERT_OK(res.getStatus());
+            loc3 = res.getValue();
+            cursor = rs->getCursor(opCtx.get());
+            auto record = cursor->next();
+            ASSERT(record);
+            ASSERT_EQ(loc3, record->id);
+            ASSERT(!cursor->next());
+
+            uow.commit();
+        }
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            ASSERT_EQ(1, rs->numRecords(opCtx.get()));
+            auto cursor = rs->getCursor(opCtx.get());
+            auto record = cursor->next();
+            ASSERT(record);
+            ASSERT_EQ(loc3, record->id);
+            ASSERT(!cursor->next());
+        }
+    }
+
+    TEST(RocksRecordStoreTest, CompactReportsProgress) {
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+                new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newNonCappedRecordStore());
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            for (int i = 0; i < 100; ++i) {
+                ASSERT_OK(rs->insertRecord(opCtx.get(), "abcd", 5, false).getStatus());
+            }
+            uow.commit();
+        }
+        harnessHelper->flush();
+
+        auto task = checked_cast<RocksRecordStore*>(rs.get())->scheduleCompaction();
+        while (!task->waitUntilDone(stdx::chrono::milliseconds(100))) {
+        }
+        ASSERT_OK(task->getStatus());
+        ASSERT_GT(task->estimatedBytes(), 0U);
+        ASSERT_EQ(task->estimatedBytes(), task->processedBytes());
+
+        // the scheduler keeps tasks nobody waits for, so they can be listed and canceled
+        const uint64_t id = task->id();
+        task.reset();
+        auto scheduler = harnessHelper->getCompactionScheduler();
+        BSONArrayBuilder tasks;
+        scheduler->appendCompactionTasks(&tasks);
+        BSONArray listed = tasks.arr();
+        ASSERT_EQ(1, listed.nFields());
+        ASSERT_EQ(static_cast<long long>(id), listed[0].Obj()["id"].numberLong());
+        ASSERT_EQ("done", listed[0].Obj()["state"].String());
+        ASSERT_OK(scheduler->cancelCompactionTask(id));
+        ASSERT_EQ(ErrorCodes::NoSuchKey, scheduler->cancelCompactionTask(id + 1).code());
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            ASSERT_OK(rs->compact(opCtx.get(), nullptr, nullptr, nullptr));
+            ASSERT_EQ(100, rs->numRecords(opCtx.get()));
+        }
+    }
+
+    class SizeValidateAdaptor : public ValidateAdaptor {
+    public:
+        Status validate(const RecordId& recordId, const RecordData& record,
+                        size_t* dataSize) override {
+            *dataSize = static_cast<size_t>(record.size());
+            return Status::OK();
+        }
+    };
+
+    TEST(RocksRecordStoreTest, ParallelValidate) {
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+                new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newNonCappedRecordStore());
+
+        // one SST file per batch, so the scan gets split into several ranges
+        for (int batch = 0; batch < 4; ++batch) {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            for (int i = 0; i < 1000; ++i) {
+                ASSERT_OK(rs->insertRecord(opCtx.get(), "abcd", 5, false).getStatus());
+            }
+            uow.commit();
+            harnessHelper->flush();
+        }
+
+        const int oldValidateThreads = rocksGlobalOptions.validateThreads;
+        rocksGlobalOptions.validateThreads = 4;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            SizeValidateAdaptor adaptor;
+            ValidateResults results;
+            BSONObjBuilder output;
+            ASSERT_OK(rs->validate(opCtx.get(), kValidateFull, &adaptor, &results, &output));
+            ASSERT(results.valid);
+            BSONObj obj = output.obj();
+            ASSERT_EQ(4000, obj["nrecords"].numberLong());
+            ASSERT_EQ(4000 * 5, rs->dataSize(opCtx.get()));
+            // SST files are only re-read when asked for
+            ASSERT_FALSE(obj.hasField("sstFilesVerified"));
+        }
+        rocksGlobalOptions.validateThreads = oldValidateThreads;
+    }
+
+    class FailingValidateAdaptor : public ValidateAdaptor {
+    public:
+        Status validate(const RecordId& recordId, const RecordData& record,
+                        size_t* dataSize) override {
+            return Status(ErrorCodes::InternalError, "records shouldn't be decoded");
+        }
+    };
+
+    TEST(RocksRecordStoreTest, ChecksumValidate) {
+        rocksGlobalOptions.validateMode.store(RocksGlobalOptions::kValidateModeChecksum);
+        ON_BLOCK_EXIT([] {
+            rocksGlobalOptions.validateMode.store(RocksGlobalOptions::kValidateModeFull);
+        });
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+                new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newNonCappedRecordStore());
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            for (int i = 0; i < 100; ++i) {
+                ASSERT_OK(rs->insertRecord(opCtx.get(), "abcd", 5, false).getStatus());
+            }
+            uow.commit();
+        }
+        harnessHelper->flush();
+
+        ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+        FailingValidateAdaptor adaptor;
+        ValidateResults results;
+        BSONObjBuilder output;
+        Status status = rs->validate(opCtx.get(), kValidateFull, &adaptor, &results, &output);
+        if (status.code() == ErrorCodes::CommandNotSupported) {
+            // RocksDB is too old to verify SST checksums
+            return;
+        }
+        ASSERT_OK(status);
+        ASSERT(results.valid);
+        BSONObj obj = output.obj();
+        ASSERT_EQ(100, obj["nrecords"].numberLong());
+        ASSERT_EQ(1, obj["sstFilesVerified"].numberLong());
+    }
+
+    class TestDocWriter final : public DocWriter {
+    public:
+        TestDocWriter(const std::string& data) : _data(data) {}
+        void writeDocument(char* buf) const override { memcpy(buf, _data.c_str(), _data.size()); }
+        size_t documentSize() const override { return _data.size(); }
+
+    private:
+        const std::string _data;
+    };
+
+    TEST(RocksRecordStoreTest, CappedMaxDocsBatchInsert) {
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+                new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newCappedRecordStore("a.b", 100000, 3));
+
+        TestDocWriter docs[] = {TestDocWriter("a"), TestDocWriter("b"), TestDocWriter("c"),
+                                TestDocWriter("d"), TestDocWriter("e")};
+        const DocWriter* docPtrs[] = {&docs[0], &docs[1], &docs[2], &docs[3], &docs[4]};
+        RecordId ids[5];
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(rs->insertRecordsWithDocWriter(opCtx.get(), docPtrs, 2, ids));
+            uow.commit();
+        }
+        // a batch gets consecutive RecordIds
+        ASSERT_EQ(ids[0].repr() + 1, ids[1].repr());
+
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(rs->insertRecordsWithDocWriter(opCtx.get(), docPtrs + 2, 3, ids + 2));
+            uow.commit();
+        }
+        ASSERT_EQ(ids[1].repr() + 1, ids[2].repr());
+        ASSERT_EQ(ids[2].repr() + 2, ids[4].repr());
+
+        {
+            // max docs is still enforced exactly
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            ASSERT_EQ(3, rs->numRecords(opCtx.get()));
+            auto cursor = rs->getCursor(opCtx.get());
+            for (int i = 2; i < 5; ++i) {
+                auto record = cursor->next();
+                ASSERT(record);
+                ASSERT_EQ(ids[i], record->id);
+            }
+            ASSERT(!cursor->next());
+        }
+    }
+
+    class CountingCappedCallback : public CappedCallback {
+    public:
+        Status aboutToDeleteCapped(OperationContext* opCtx, const RecordId& loc,
+                                   RecordData data) override {
+            return Status::OK();
+        }
+        bool haveCappedWaiters() override { return true; }
+        void notifyCappedWaitersIfNeeded() override { notifications++; }
+
+        int notifications = 0;
+    };
+
+    TEST(RocksRecordStoreTest, CappedVisibilityWakesUpWaiters) {
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+                new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newCappedRecordStore("a.b", 100000, -1));
+        CountingCappedCallback callback;
+        dynamic_cast<RocksRecordStore*>(rs.get())->setCappedCallback(&callback);
+
+        {
+            ServiceContext::UniqueOperationContext t1(harnessHelper->newOperationContext());
+            WriteUnitOfWork w1(t1.get());
+            ASSERT_OK(rs->insertRecord(t1.get(), "b", 2, false).getStatus());
+
+            {
+                auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+                auto t2 = harnessHelper->newOperationContext(client2.get());
+                WriteUnitOfWork w2(t2.get());
+                ASSERT_OK(rs->insertRecord(t2.get(), "c", 2, false).getStatus());
+                w2.commit();
+            }
+
+            // the 2nd record is still hidden behind the 1st one, nothing new to see
+            ASSERT_EQ(0, callback.notifications);
+
+            w1.commit();
+        }
+
+        // committing the oldest uncommitted record makes both records visible
+        ASSERT_EQ(1, callback.notifications);
+
+        {
+            ServiceContext::UniqueOperationContext t1(harnessHelper->newOperationContext());
+            WriteUnitOfWork w1(t1.get());
+            ASSERT_OK(rs->insertRecord(t1.get(), "d", 2, false).getStatus());
+
+            {
+                auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+                auto t2 = harnessHelper->newOperationContext(client2.get());
+                WriteUnitOfWork w2(t2.get());
+                ASSERT_OK(rs->insertRecord(t2.get(), "e", 2, false).getStatus());
+                w2.commit();
+            }
+            ASSERT_EQ(1, callback.notifications);
+            // w1 rolls back
+        }
+
+        // rolling back the oldest uncommitted record makes the one after it visible
+        ASSERT_EQ(2, callback.notifications);
+        dynamic_cast<RocksRecordStore*>(rs.get())->setCappedCallback(nullptr);
+    }
+
+    TEST(RocksRecordStoreTest, SharedSnapshot) {
+        rocksGlobalOptions.sharedSnapshotMaxAgeMillis = 1000 * 1000;
+        ON_BLOCK_EXIT([] { rocksGlobalOptions.sharedSnapshotMaxAgeMillis = 0; });
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+            new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newNonCappedRecordStore());
+
+        auto writer = harnessHelper->newOperationContext();
+        RecordId first;
+        {
+            WriteUnitOfWork uow(writer.get());
+            auto res = rs->insertRecord(writer.get(), "a", 2, false);
+            ASSERT_OK(res.getStatus());
+            first = res.getValue();
+            uow.commit();
+        }
+
+        auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+        auto reader = harnessHelper->newOperationContext(client2.get());
+        RecordData data;
+        ASSERT_TRUE(rs->findRecord(reader.get(), first, &data));
+
+        RecordId second;
+        {
+            WriteUnitOfWork uow(writer.get());
+            auto res = rs->insertRecord(writer.get(), "b", 2, false);
+            ASSERT_OK(res.getStatus());
+            second = res.getValue();
+            uow.commit();
+        }
+        // the writer reads its own writes, even though the shared snapshot predates them
+        ASSERT_TRUE(rs->findRecord(writer.get(), second, &data));
+
+        // a new reader shares the writer's snapshot, which is newer than the second insert
+        auto client3 = harnessHelper->serviceContext()->makeClient("c3");
+        auto reader2 = harnessHelper->newOperationContext(client3.get());
+        ASSERT_TRUE(rs->findRecord(reader2.get(), second, &data));
+
+        // the first reader keeps the snapshot it started with
+        ASSERT_FALSE(rs->findRecord(reader.get(), second, &data));
+        {
+            // units of work read from their own, current snapshot
+            WriteUnitOfWork uow(reader.get());
+            ASSERT_TRUE(rs->findRecord(reader.get(), second, &data));
+        }
+    }
+
+    TEST(RocksRecordStoreTest, SharedSnapshotSeesClientsEarlierWrites) {
+        rocksGlobalOptions.sharedSnapshotMaxAgeMillis = 1000 * 1000;
+        ON_BLOCK_EXIT([] { rocksGlobalOptions.sharedSnapshotMaxAgeMillis = 0; });
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+            new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newNonCappedRecordStore());
+
+        // publishes a shared snapshot that predates the write below
+        auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+        {
+            auto reader = harnessHelper->newOperationContext(client2.get());
+            RecordData data;
+            ASSERT_FALSE(rs->findRecord(reader.get(), RecordId(1), &data));
+        }
+
+        auto client1 = harnessHelper->serviceContext()->makeClient("c1");
+        RecordId loc;
+        {
+            auto writer = harnessHelper->newOperationContext(client1.get());
+            WriteUnitOfWork uow(writer.get());
+            auto res = rs->insertRecord(writer.get(), "a", 2, false);
+            ASSERT_OK(res.getStatus());
+            loc = res.getValue();
+            uow.commit();
+        }
+
+        RecordData data;
+        {
+            // other clients may read from the older shared snapshot
+            auto reader = harnessHelper->newOperationContext(client2.get());
+            ASSERT_FALSE(rs->findRecord(reader.get(), loc, &data));
+        }
+        {
+            // but the writer's next operation, with a new recovery unit, sees its write
+            auto reader = harnessHelper->newOperationContext(client1.get());
+            ASSERT_TRUE(rs->findRecord(reader.get(), loc, &data));
+        }
+    }
+
+    TEST(RocksRecordStoreTest, OplogReadersDontShareSnapshots) {
+        rocksGlobalOptions.sharedSnapshotMaxAgeMillis = 1000 * 1000;
+        ON_BLOCK_EXIT([] { rocksGlobalOptions.sharedSnapshotMaxAgeMillis = 0; });
+        RocksRecordStoreHarnessHelper harnessHelper;
+        std::unique_ptr<RecordStore> rs(harnessHelper.newNonCappedRecordStore("local.oplog.foo"));
+
+        // publishes a shared snapshot that predates the oplog entry
+        auto client2 = harnessHelper.serviceContext()->makeClient("c2");
+        auto reader = harnessHelper.newOperationContext(client2.get());
+        RecordData data;
+        ASSERT_FALSE(rs->findRecord(reader.get(), RecordId(1, 1), &data));
+
+        {
+            ServiceContext::UniqueOperationContext writer(harnessHelper.newOperationContext());
+            ASSERT_EQ(insertBSON(writer, rs, Timestamp(1, 1)).getValue(), RecordId(1, 1));
+        }
+
+        // the reader that attached the old snapshot can't open an oplog cursor without
+        // abandoning it
+        ASSERT_TRUE(RocksRecoveryUnit::getRocksRecoveryUnit(reader.get())->hasSnapshot());
+
+        auto client3 = harnessHelper.serviceContext()->makeClient("c3");
+        auto oplogReader = harnessHelper.newOperationContext(client3.get());
+        auto cursor = rs->getCursor(oplogReader.get(), true);
+        auto record = cursor->next();
+        ASSERT_TRUE(record);
+        ASSERT_EQ(RecordId(1, 1), record->id);
+    }
+
+    TEST(RocksRecordStoreTest, MajoritySnapshotLimit) {
+        rocksGlobalOptions.maxMajoritySnapshots = 3;
+        ON_BLOCK_EXIT([] { rocksGlobalOptions.maxMajoritySnapshots = 0; });
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+            new RocksRecordStoreHarnessHelper());
+        RocksSnapshotManager snapshotManager;
+
+        auto createSnapshot = [&](uint64_t name) {
+            auto opCtx = harnessHelper->newOperationContext();
+            ASSERT_OK(snapshotManager.prepareForCreateSnapshot(opCtx.get()));
+            ASSERT_OK(snapshotManager.createSnapshot(opCtx.get(), SnapshotName(name)));
+        };
+        auto count = [&] {
+            BSONObjBuilder builder;
+            snapshotManager.appendStats(&builder);
+            return builder.obj()["count"].numberLong();
+        };
+
+        // any of them could still become majority committed
+        for (uint64_t name : {10, 20, 21, 30, 40}) {
+            createSnapshot(name);
+        }
+        ASSERT_EQ(5, count());
+
+        // the committed snapshot is the one we were told about, never an older one
+        snapshotManager.setCommittedSnapshot(SnapshotName(21));
+        ASSERT_EQ(21U, snapshotManager.getCommittedSnapshot()->name);
+
+        // 10 and 20 can't be committed anymore, so they go once we're over the limit
+        createSnapshot(50);
+        ASSERT_EQ(4, count());
+        ASSERT_EQ(21U, snapshotManager.getCommittedSnapshot()->name);
+
+        snapshotManager.setCommittedSnapshot(SnapshotName(30));
+        ASSERT_EQ(30U, snapshotManager.getCommittedSnapshot()->name);
+        snapshotManager.cleanupUnneededSnapshots();
+        ASSERT_EQ(3, count());
+        snapshotManager.dropAllSnapshots();
+    }
+
+    TEST(RocksRecordStoreTest, MajoritySnapshotMaxAge) {
+        rocksGlobalOptions.maxMajoritySnapshotAgeSecs = 1;
+        ON_BLOCK_EXIT([] { rocksGlobalOptions.maxMajoritySnapshotAgeSecs = 0; });
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+            new RocksRecordStoreHarnessHelper());
+        RocksSnapshotManager snapshotManager;
+
+        auto createSnapshot = [&](uint64_t name) {
+            auto opCtx = harnessHelper->newOperationContext();
+            ASSERT_OK(snapshotManager.prepareForCreateSnapshot(opCtx.get()));
+            ASSERT_OK(snapshotManager.createSnapshot(opCtx.get(), SnapshotName(name)));
+        };
+
+        createSnapshot(10);
+        createSnapshot(20);
+        snapshotManager.setCommittedSnapshot(SnapshotName(10));
+        ASSERT_TRUE(snapshotManager.haveCommittedSnapshot());
+
+        // the majority commit point lags by more than the max age: 10 and 20 are released, and
+        // majority reads fail instead of reading from a snapshot that misses committed writes
+        sleepmillis(1100);
+        createSnapshot(30);
+        ASSERT_FALSE(snapshotManager.haveCommittedSnapshot());
+        ASSERT_THROWS_CODE(snapshotManager.getCommittedSnapshot(), UserException,
+                           ErrorCodes::ReadConcernMajorityNotAvailableYet);
+        snapshotManager.setCommittedSnapshot(SnapshotName(20));
+        ASSERT_FALSE(snapshotManager.haveCommittedSnapshot());
+
+        // they work again once a snapshot we still have is majority committed
+        snapshotManager.setCommittedSnapshot(SnapshotName(30));
+        ASSERT_EQ(30U, snapshotManager.getCommittedSnapshot()->name);
+        snapshotManager.dropAllSnapshots();
+    }
+
+    long long numWalSyncs(RocksRecordStoreHarnessHelper* harnessHelper) {
+        BSONObjBuilder builder;
+        harnessHelper->getDurabilityManager()->appendSyncStats(&builder);
+        return builder.obj()["latency-micros"]["count"].numberLong();
+    }
+
+    TEST(RocksRecordStoreTest, WaitUntilDurableSharesSyncs) {
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+            new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(harnessHelper->newNonCappedRecordStore());
+        ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+        {
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(rs->insertRecord(opCtx.get(), "a", 2, false).getStatus());
+            uow.commit();
+        }
+
+        const long long syncsBefore = numWalSyncs(harnessHelper.get());
+        opCtx->recoveryUnit()->waitUntilDurable();
+        ASSERT_EQ(syncsBefore + 1, numWalSyncs(harnessHelper.get()));
+        // nothing was written since, so there is nothing to sync
+        opCtx->recoveryUnit()->waitUntilDurable();
+        ASSERT_EQ(syncsBefore + 1, numWalSyncs(harnessHelper.get()));
+
+        {
+            WriteUnitOfWork uow(opCtx.get());
+            ASSERT_OK(rs->insertRecord(opCtx.get(), "b", 2, false).getStatus());
+            uow.commit();
+        }
+        opCtx->recoveryUnit()->waitUntilDurable();
+        ASSERT_EQ(syncsBefore + 2, numWalSyncs(harnessHelper.get()));
+    }
+
     RecordId _oplogOrderInsertOplog( OperationContext* opCtx,
                                     std::unique_ptr<RecordStore>& rs,
                                     int inc ) {
@@ -619,4 +1153,59 @@ namespace mongo {
         }
     }
 
+    TEST(RocksRecordStoreTest, OplogTruncateAfterWaitsForHiddenCommits) {
+        std::unique_ptr<RocksRecordStoreHarnessHelper> harnessHelper(
+            new RocksRecordStoreHarnessHelper());
+        std::unique_ptr<RecordStore> rs(
+            harnessHelper->newCappedRecordStore("local.oplog.foo", 100000, -1));
+
+        RecordId loc1;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            loc1 = _oplogOrderInsertOplog(opCtx.get(), rs, 1);
+            uow.commit();
+        }
+
+        {
+            // the first commit isn't the newest record, so it stays hidden until it's journaled
+            auto client1 = harnessHelper->serviceContext()->makeClient("c1");
+            auto t1 = harnessHelper->newOperationContext(client1.get());
+            auto client2 = harnessHelper->serviceContext()->makeClient("c2");
+            auto t2 = harnessHelper->newOperationContext(client2.get());
+            WriteUnitOfWork w1(t1.get());
+            _oplogOrderInsertOplog(t1.get(), rs, 20);
+            WriteUnitOfWork w2(t2.get());
+            _oplogOrderInsertOplog(t2.get(), rs, 30);
+            w1.commit();
+            w2.commit();
+        }
+
+        {
+            // no waitForAllEarlierOplogWritesToBeVisible() before truncating
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            rs->cappedTruncateAfter(opCtx.get(), loc1, /*inclusive*/ false);
+            ASSERT_EQ(1, rs->numRecords(opCtx.get()));
+        }
+
+        RecordId loc2;
+        {
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            WriteUnitOfWork uow(opCtx.get());
+            loc2 = _oplogOrderInsertOplog(opCtx.get(), rs, 25);
+            uow.commit();
+        }
+
+        {
+            // nothing truncated is left hiding the record written afterwards
+            ServiceContext::UniqueOperationContext opCtx(harnessHelper->newOperationContext());
+            auto cursor = rs->getCursor(opCtx.get());
+            ASSERT_EQ(loc1, cursor->seekExact(loc1)->id);
+            auto record = cursor->next();
+            ASSERT(record);
+            ASSERT_EQ(loc2, record->id);
+            ASSERT(!cursor->next());
+        }
+    }
+
 }
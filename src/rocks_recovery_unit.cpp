@@ -32,6 +32,8 @@
 
 #include "rocks_recovery_unit.h"
 
+#include <algorithm>
+
 #include <rocksdb/comparator.h>
 #include <rocksdb/db.h>
 #include <rocksdb/iterator.h>
@@ -45,11 +47,16 @@
 #include <rocksdb/utilities/write_batch_with_index.h>
 
 #include "mongo/base/checked_cast.h"
+#include "mongo/db/client.h"
 #include "mongo/db/concurrency/write_conflict_exception.h"
 #include "mongo/db/operation_context.h"
 #include "mongo/db/storage/journal_listener.h"
+#include "mongo/stdx/memory.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/stdx/thread.h"
 #include "mongo/util/log.h"
 
+#include "rocks_global_options.h"
 #include "rocks_transaction.h"
 #include "rocks_util.h"
 
@@ -62,12 +69,90 @@ namespace mongo {
         // so there is a chance the snapshot ID will be reused.
         AtomicUInt64 nextSnapshotId{1};
 
+        // Sequence number after the latest commit of the client. Every operation gets a new
+        // recovery unit, so this is what keeps a client's later reads from a shared snapshot from
+        // missing its own acknowledged writes.
+        const auto clientLastCommitSequenceNumber = Client::declareDecoration<uint64_t>();
+
+        // Keeps what destroyed recovery units allocated for their units of work (write batches,
+        // counter map buckets, change list capacity), so that a new recovery unit starts out
+        // with it instead of allocating it again. Free lists are sharded by thread, so a thread
+        // mostly takes back what its previous recovery unit released, without contention. Small
+        // caps keep the idle memory at a few megabytes: only buffers of up to
+        // kMaxPooledBatchBytes are kept, and at most kMaxPerShard of them per shard.
+        class PooledBuffersPool {
+        public:
+            using PooledBuffers = RocksRecoveryUnit::PooledBuffers;
+
+            std::unique_ptr<PooledBuffers> get() {
+                auto& shard = _shard();
+                {
+                    stdx::lock_guard<stdx::mutex> lk(shard.lock);
+                    if (!shard.free.empty()) {
+                        auto buffers = std::move(shard.free.back());
+                        shard.free.pop_back();
+                        return buffers;
+                    }
+                }
+                auto buffers = stdx::make_unique<PooledBuffers>();
+                buffers->writeBatch = stdx::make_unique<rocksdb::WriteBatchWithIndex>(
+                    rocksdb::BytewiseComparator(), 0, true);
+                buffers->unindexedBatch = stdx::make_unique<rocksdb::WriteBatch>();
+                return buffers;
+            }
+
+            // The batches, the counter map and the change list must be empty
+            void release(std::unique_ptr<PooledBuffers> buffers) {
+                invariant(buffers->writeBatch->GetWriteBatch()->Count() == 0);
+                invariant(buffers->unindexedBatch->Count() == 0);
+                invariant(buffers->deltaCounters.empty() && buffers->changes.empty());
+                const size_t batchBytes =
+                    std::max(buffers->writeBatch->GetWriteBatch()->Data().capacity(),
+                             buffers->unindexedBatch->Data().capacity());
+                if (batchBytes > kMaxPooledBatchBytes) {
+                    return;
+                }
+                auto& shard = _shard();
+                stdx::lock_guard<stdx::mutex> lk(shard.lock);
+                if (shard.free.size() < kMaxPerShard) {
+                    shard.free.push_back(std::move(buffers));
+                }
+            }
+
+        private:
+            static const size_t kNumShards = 16;
+            static const size_t kMaxPerShard = 4;
+            static const size_t kMaxPooledBatchBytes = 64 * 1024;
+
+            struct Shard {
+                stdx::mutex lock;
+                std::vector<std::unique_ptr<PooledBuffers>> free;
+            };
+
+            Shard& _shard() {
+                return _shards[std::hash<stdx::thread::id>()(stdx::this_thread::get_id()) %
+                               kNumShards];
+            }
+
+            Shard _shards[kNumShards];
+        };
+
+        // Intentionally leaked, so that recovery units destroyed late in shutdown can still
+        // release their buffers into it.
+        PooledBuffersPool* const pooledBuffersPool = new PooledBuffersPool();
+
         class PrefixStrippingIterator : public RocksIterator {
         public:
-            // baseIterator is consumed
+            // baseIterator is consumed. If it reads the DB directly while recoveryUnit has no
+            // writes, the iterator switches to a view merged with the write batch as soon as
+            // recoveryUnit writes something.
             PrefixStrippingIterator(std::string prefix, Iterator* baseIterator,
                                     RocksCompactionScheduler* compactionScheduler,
-                                    std::unique_ptr<rocksdb::Slice> upperBound)
+                                    std::unique_ptr<rocksdb::Slice> upperBound,
+                                    std::unique_ptr<rocksdb::Slice> lowerBound,
+                                    RocksRecoveryUnit* recoveryUnit = nullptr,
+                                    rocksdb::ColumnFamilyHandle* cfHandle = nullptr,
+                                    bool mergedWithWriteBatch = true)
                 : _rocksdbSkippedDeletionsInitial(0),
                   _prefix(std::move(prefix)),
                   _nextPrefix(rocksGetNextPrefix(_prefix)),
@@ -75,8 +160,17 @@ namespace mongo {
                   _prefixSliceEpsilon(_prefix.data(), _prefix.size() + 1),
                   _baseIterator(baseIterator),
                   _compactionScheduler(compactionScheduler),
-                  _upperBound(std::move(upperBound)) {
-                *_upperBound.get() = rocksdb::Slice(_nextPrefix);
+                  _upperBound(std::move(upperBound)),
+                  _upperBoundKey(_nextPrefix),
+                  _lowerBound(std::move(lowerBound)),
+                  _lowerBoundKey(_prefixSliceEpsilon.ToString()),
+                  _recoveryUnit(recoveryUnit),
+                  _cfHandle(cfHandle),
+                  _mergedWithWriteBatch(mergedWithWriteBatch || recoveryUnit == nullptr) {
+                *_upperBound.get() = rocksdb::Slice(_upperBoundKey);
+                if (_lowerBound) {
+                    *_lowerBound.get() = rocksdb::Slice(_lowerBoundKey);
+                }
             }
 
             ~PrefixStrippingIterator() {}
@@ -87,51 +181,66 @@ namespace mongo {
             }
 
             virtual void SeekToFirst() {
-                startOp();
+                startOp(true);
+                mergeWriteBatchIfNeeded();
                 // seek to first key bigger than prefix
                 _baseIterator->Seek(_prefixSliceEpsilon);
+                skipRangeDeletedKeys(true);
                 endOp();
             }
             virtual void SeekToLast() {
-                startOp();
-                // we can't have upper bound set to _nextPrefix since we need to seek to it
-                *_upperBound.get() = rocksdb::Slice("\xFF\xFF\xFF\xFF");
-                _baseIterator->Seek(_nextPrefix);
-                // reset back to original value
-                *_upperBound.get() = rocksdb::Slice(_nextPrefix);
-                if (!_baseIterator->Valid()) {
-                    _baseIterator->SeekToLast();
-                }
-                if (_baseIterator->Valid() && !_baseIterator->key().starts_with(_prefixSlice)) {
-                    _baseIterator->Prev();
-                }
+                startOp(true);
+                mergeWriteBatchIfNeeded();
+                _baseIterator->SeekForPrev(_upperBoundKey);
+                skipKeysAtOrAfterUpperBound();
+                skipRangeDeletedKeys(false);
                 endOp();
             }
 
             virtual void Seek(const rocksdb::Slice& target) {
-                startOp();
-                std::unique_ptr<char[]> buffer(new char[_prefix.size() + target.size()]);
-                memcpy(buffer.get(), _prefix.data(), _prefix.size());
-                memcpy(buffer.get() + _prefix.size(), target.data(), target.size());
-                _baseIterator->Seek(rocksdb::Slice(buffer.get(), _prefix.size() + target.size()));
+                startOp(true);
+                mergeWriteBatchIfNeeded();
+                _baseIterator->Seek(prefixedSeekKey(target));
+                skipRangeDeletedKeys(true);
                 endOp();
             }
 
             virtual void Next() {
-                startOp();
-                _baseIterator->Next();
+                startOp(false);
+                if (mergeWriteBatchIfNeeded() && !_currentKey.empty()) {
+                    // reposition on the current key, which the batch might have deleted
+                    _baseIterator->Seek(_currentKey);
+                    if (_baseIterator->Valid() && _baseIterator->key() == _currentKey) {
+                        _baseIterator->Next();
+                    }
+                } else {
+                    _baseIterator->Next();
+                }
+                skipRangeDeletedKeys(true);
                 endOp();
             }
 
             virtual void Prev() {
-                startOp();
-                _baseIterator->Prev();
+                startOp(false);
+                if (mergeWriteBatchIfNeeded() && !_currentKey.empty()) {
+                    _baseIterator->SeekForPrev(_currentKey);
+                    if (_baseIterator->Valid() && _baseIterator->key() == _currentKey) {
+                        _baseIterator->Prev();
+                    }
+                } else {
+                    _baseIterator->Prev();
+                }
+                skipRangeDeletedKeys(false);
                 endOp();
             }
 
             virtual void SeekForPrev(const rocksdb::Slice& target) {
-              // noop since we don't use it and it's only available in
-              // RocksDB 4.12 and higher
+                startOp(true);
+                mergeWriteBatchIfNeeded();
+                _baseIterator->SeekForPrev(prefixedSeekKey(target));
+                skipKeysAtOrAfterUpperBound();
+                skipRangeDeletedKeys(false);
+                endOp();
             }
 
             virtual rocksdb::Slice key() const {
@@ -147,41 +256,125 @@ namespace mongo {
             // This Seek is specific because it will succeed only if it finds a key with `target`
             // prefix. If there is no such key, it will be !Valid()
             virtual void SeekPrefix(const rocksdb::Slice& target) {
-                std::unique_ptr<char[]> buffer(new char[_prefix.size() + target.size()]);
-                memcpy(buffer.get(), _prefix.data(), _prefix.size());
-                memcpy(buffer.get() + _prefix.size(), target.data(), target.size());
-
-                std::string tempUpperBound = rocksGetNextPrefix(
-                    rocksdb::Slice(buffer.get(), _prefix.size() + target.size()));
+                mergeWriteBatchIfNeeded();
+                auto seekKey = prefixedSeekKey(target);
+                _seekUpperBoundKey.assign(seekKey.data(), seekKey.size());
+                rocksSetNextPrefix(&_seekUpperBoundKey);
 
-                *_upperBound.get() = rocksdb::Slice(tempUpperBound);
+                *_upperBound.get() = rocksdb::Slice(_seekUpperBoundKey);
                 if (target.size() == 0) {
                     // if target is empty, we'll try to seek to <prefix>, which is not good
                     _baseIterator->Seek(_prefixSliceEpsilon);
                 } else {
-                    _baseIterator->Seek(
-                        rocksdb::Slice(buffer.get(), _prefix.size() + target.size()));
+                    _baseIterator->Seek(seekKey);
                 }
+                skipRangeDeletedKeys(true);
                 // reset back to original value
-                *_upperBound.get() = rocksdb::Slice(_nextPrefix);
+                *_upperBound.get() = rocksdb::Slice(_upperBoundKey);
+            }
+
+            // Builds the bounds in place, so that cursors moving their end position don't
+            // allocate once the buffers are big enough
+            virtual void setBounds(const rocksdb::Slice& lower, const rocksdb::Slice& upper) {
+                if (upper.empty()) {
+                    _upperBoundKey.assign(_nextPrefix);
+                } else {
+                    _upperBoundKey.assign(_prefix);
+                    _upperBoundKey.append(upper.data(), upper.size());
+                }
+                *_upperBound.get() = rocksdb::Slice(_upperBoundKey);
+
+                if (_lowerBound) {
+                    if (lower.empty()) {
+                        _lowerBoundKey.assign(_prefixSliceEpsilon.data(),
+                                              _prefixSliceEpsilon.size());
+                    } else {
+                        _lowerBoundKey.assign(_prefix);
+                        _lowerBoundKey.append(lower.data(), lower.size());
+                    }
+                    *_lowerBound.get() = rocksdb::Slice(_lowerBoundKey);
+                }
             }
 
         private:
-            void startOp() {
+            // Wraps the base iterator with the write batch once the recovery unit has writes.
+            // Returns true if it did; the new iterator is unpositioned then, and _currentKey holds
+            // the key the old one was on (empty if it wasn't valid).
+            bool mergeWriteBatchIfNeeded() {
+                if (_mergedWithWriteBatch || !_recoveryUnit->hasPendingWrites()) {
+                    return false;
+                }
+                _currentKey.clear();
+                if (_baseIterator->Valid()) {
+                    _currentKey.assign(_baseIterator->key().data(), _baseIterator->key().size());
+                }
+                _baseIterator.reset(_recoveryUnit->wrapWithWriteBatch(_baseIterator.release()));
+                _mergedWithWriteBatch = true;
+                return true;
+            }
+
+            // Builds <prefix><target> in a buffer that lives as long as the iterator, so that
+            // seeking doesn't allocate once the buffer is big enough. Valid until the next call.
+            rocksdb::Slice prefixedSeekKey(const rocksdb::Slice& target) {
+                _seekKey.assign(_prefix);
+                _seekKey.append(target.data(), target.size());
+                return rocksdb::Slice(_seekKey);
+            }
+
+            // The upper bound doesn't apply to the write batch, so a reverse seek to or past it
+            // can land on a key from the batch that belongs to the next prefix
+            void skipKeysAtOrAfterUpperBound() {
+                while (_baseIterator->Valid() &&
+                       _baseIterator->key().compare(rocksdb::Slice(_upperBoundKey)) >= 0) {
+                    _baseIterator->Prev();
+                }
+            }
+
+            // The base iterator doesn't know about ranges deleted by the recovery unit (see
+            // RocksRecoveryUnit::deleteRange()), so we step over them here. This is slow for big
+            // ranges, but reading a range back in the same unit of work that deleted it is rare.
+            void skipRangeDeletedKeys(bool forward) {
+                if (_recoveryUnit == nullptr || !_recoveryUnit->hasRangeDeletions()) {
+                    return;
+                }
+                while (_baseIterator->Valid() &&
+                       _recoveryUnit->isDeletedByRange(_cfHandle, _baseIterator->key())) {
+                    if (forward) {
+                        _baseIterator->Next();
+                    } else {
+                        _baseIterator->Prev();
+                    }
+                }
+            }
+
+            // Counting the deletions an operation skips needs perf counters, which slow down
+            // everything RocksDB does on the thread while they're on. So we only count seeks and
+            // one in kStepSampleInterval Next()/Prev(), and turn the counters off again after.
+            void startOp(bool isSeek) {
                 if (_compactionScheduler == nullptr) {
                     return;
                 }
-                if (rocksdb::GetPerfLevel() == rocksdb::PerfLevel::kDisable) {
+                if (!isSeek && ++_stepsSinceSample < kStepSampleInterval) {
+                    return;
+                }
+                _stepsSinceSample = 0;
+                _measuringOp = true;
+                _previousPerfLevel = rocksdb::GetPerfLevel();
+                if (_previousPerfLevel < rocksdb::kEnableCount) {
                     rocksdb::SetPerfLevel(rocksdb::kEnableCount);
                 }
                 _rocksdbSkippedDeletionsInitial = get_internal_delete_skipped_count();
             }
             void endOp() {
-                if (_compactionScheduler == nullptr) {
+                if (!_measuringOp) {
                     return;
                 }
+                _measuringOp = false;
                 int skippedDeletionsOp = get_internal_delete_skipped_count() -
                                          _rocksdbSkippedDeletionsInitial;
+                if (_previousPerfLevel < rocksdb::kEnableCount) {
+                    rocksdb::SetPerfLevel(_previousPerfLevel);
+                }
                 if (skippedDeletionsOp >=
                     RocksCompactionScheduler::getSkippedDeletionsThreshold()) {
                     _compactionScheduler->reportSkippedDeletionsAboveThreshold(_prefix);
@@ -195,7 +388,12 @@ namespace mongo {
                 #endif
             }
 
+            static const int kStepSampleInterval = 64;
+
             int _rocksdbSkippedDeletionsInitial;
+            bool _measuringOp = false;
+            rocksdb::PerfLevel _previousPerfLevel = rocksdb::kDisable;
+            int _stepsSinceSample = 0;
 
             std::string _prefix;
             std::string _nextPrefix;
@@ -207,7 +405,66 @@ namespace mongo {
             // can be nullptr
             RocksCompactionScheduler* _compactionScheduler;  // not owned
 
+            // the slices RocksDB reads the bounds from, and the keys they point to
             std::unique_ptr<rocksdb::Slice> _upperBound;
+            std::string _upperBoundKey;
+            // nullptr if this RocksDB doesn't support iterate_lower_bound
+            std::unique_ptr<rocksdb::Slice> _lowerBound;
+            std::string _lowerBoundKey;
+            // scratch space of prefixedSeekKey() and SeekPrefix()
+            std::string _seekKey;
+            std::string _seekUpperBoundKey;
+
+            // nullptr if the iterator doesn't read through a recovery unit
+            RocksRecoveryUnit* _recoveryUnit;  // not owned
+            rocksdb::ColumnFamilyHandle* _cfHandle;  // not owned
+
+            // false while the base iterator reads the DB without the write batch
+            bool _mergedWithWriteBatch;
+            std::string _currentKey;
+        };
+
+        // Returns the slice options->iterate_lower_bound points to, or nullptr if this RocksDB
+        // doesn't support lower bounds.
+        std::unique_ptr<rocksdb::Slice> setLowerBound(rocksdb::ReadOptions* options) {
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 13)
+            std::unique_ptr<rocksdb::Slice> lowerBound(new rocksdb::Slice());
+            options->iterate_lower_bound = lowerBound.get();
+            return lowerBound;
+#else
+            return nullptr;
+#endif
+        }
+
+        uint32_t columnFamilyId(rocksdb::ColumnFamilyHandle* cfHandle) {
+            return cfHandle ? cfHandle->GetID() : 0;
+        }
+
+        // Replays a batch of the default column family into a WriteBatchWithIndex. Range
+        // deletions never show up here, deleteRange() indexes the batch first.
+        class WriteBatchIndexer : public rocksdb::WriteBatch::Handler {
+        public:
+            explicit WriteBatchIndexer(rocksdb::WriteBatchWithIndex* target) : _target(target) {}
+
+            virtual rocksdb::Status PutCF(uint32_t cfId, const rocksdb::Slice& key,
+                                          const rocksdb::Slice& value) {
+                invariant(cfId == 0);
+                _target->Put(key, value);
+                return rocksdb::Status::OK();
+            }
+            virtual rocksdb::Status DeleteCF(uint32_t cfId, const rocksdb::Slice& key) {
+                invariant(cfId == 0);
+                _target->Delete(key);
+                return rocksdb::Status::OK();
+            }
+            virtual rocksdb::Status SingleDeleteCF(uint32_t cfId, const rocksdb::Slice& key) {
+                invariant(cfId == 0);
+                _target->SingleDelete(key);
+                return rocksdb::Status::OK();
+            }
+
+        private:
+            rocksdb::WriteBatchWithIndex* _target;  // not owned
         };
 
     }  // anonymous namespace
@@ -219,7 +476,7 @@ namespace mongo {
                                          RocksCounterManager* counterManager,
                                          RocksCompactionScheduler* compactionScheduler,
                                          RocksDurabilityManager* durabilityManager,
-                                         bool durable)
+                                         bool durable, bool indexWritesLazily)
         : _transactionEngine(transactionEngine),
           _snapshotManager(snapshotManager),
           _db(db),
@@ -227,11 +484,18 @@ namespace mongo {
           _compactionScheduler(compactionScheduler),
           _durabilityManager(durabilityManager),
           _durable(durable),
+          _indexWritesLazily(indexWritesLazily),
           _transaction(transactionEngine),
-          _writeBatch(rocksdb::BytewiseComparator(), 0, true),
+          _pooledBuffers(pooledBuffersPool->get()),
+          _writeBatch(std::move(_pooledBuffers->writeBatch)),
+          _unindexedBatch(std::move(_pooledBuffers->unindexedBatch)),
+          _writeBatchIndexed(!indexWritesLazily),
           _snapshot(nullptr),
           _preparedSnapshot(nullptr),
+          _rangeCheckIteratorCfId(0),
           _mySnapshotId(nextSnapshotId.fetchAndAdd(1)) {
+        _deltaCounters.swap(_pooledBuffers->deltaCounters);
+        _changes.mutableVector().swap(_pooledBuffers->changes);
         RocksRecoveryUnit::_totalLiveRecoveryUnits.fetch_add(1, std::memory_order_relaxed);
     }
 
@@ -242,17 +506,36 @@ namespace mongo {
             _preparedSnapshot = nullptr;
         }
         _abort();
+        _pooledBuffers->writeBatch = std::move(_writeBatch);
+        _pooledBuffers->unindexedBatch = std::move(_unindexedBatch);
+        _deltaCounters.swap(_pooledBuffers->deltaCounters);
+        _changes.mutableVector().swap(_pooledBuffers->changes);
+        pooledBuffersPool->release(std::move(_pooledBuffers));
         RocksRecoveryUnit::_totalLiveRecoveryUnits.fetch_sub(1, std::memory_order_relaxed);
     }
 
     void RocksRecoveryUnit::beginUnitOfWork(OperationContext* opCtx) {
         invariant(!_areWriteUnitOfWorksBanned);
+        _inUnitOfWork = true;
+        if (opCtx) {
+            _client = opCtx->getClient();
+        }
+        if (_sharedSnapshot) {
+            // Writes have to be checked for conflicts against the snapshot they read from, which
+            // a shared snapshot isn't registered for, so the unit of work reads from its own
+            // snapshot. Cursors opened before keep reading the shared one, which we keep alive
+            // until the snapshot is released. Mixing the two is what any snapshot change does:
+            // the new snapshot id makes callers fetch again what they read before writing it.
+            _retiredSharedSnapshot = std::move(_sharedSnapshot);
+            _mySnapshotId = nextSnapshotId.fetchAndAdd(1);
+        }
     }
 
     void RocksRecoveryUnit::commitUnitOfWork() {
-        if (_writeBatch.GetWriteBatch()->Count() > 0) {
+        if (hasPendingWrites()) {
             _commit();
         }
+        _inUnitOfWork = false;
 
         try {
             for (Changes::const_iterator it = _changes.begin(), end = _changes.end(); it != end;
@@ -269,6 +552,7 @@ namespace mongo {
     }
 
     void RocksRecoveryUnit::abortUnitOfWork() {
+        _inUnitOfWork = false;
         _abort();
     }
 
@@ -279,12 +563,41 @@ namespace mongo {
 
     void RocksRecoveryUnit::abandonSnapshot() {
         _deltaCounters.clear();
-        _writeBatch.Clear();
+        _clearWriteBatch();
+        _deletedRanges.clear();
         _releaseSnapshot();
         _areWriteUnitOfWorksBanned = false;
     }
 
-    rocksdb::WriteBatchWithIndex* RocksRecoveryUnit::writeBatch() { return &_writeBatch; }
+    rocksdb::WriteBatchBase* RocksRecoveryUnit::writeBatch() {
+        if (_writeBatchIndexed) {
+            return _writeBatch.get();
+        }
+        return _unindexedBatch.get();
+    }
+
+    rocksdb::Iterator* RocksRecoveryUnit::wrapWithWriteBatch(rocksdb::Iterator* base) {
+        _indexWriteBatch();
+        return _writeBatch->NewIteratorWithBase(base);
+    }
+
+    void RocksRecoveryUnit::_indexWriteBatch() {
+        if (_writeBatchIndexed) {
+            return;
+        }
+        WriteBatchIndexer indexer(_writeBatch.get());
+        invariantRocksOK(_unindexedBatch->Iterate(&indexer));
+        _unindexedBatch->Clear();
+        _writeBatchIndexed = true;
+    }
+
+    void RocksRecoveryUnit::_clearWriteBatch() {
+        // points into the index we're about to clear
+        _rangeCheckIterator.reset();
+        _writeBatch->Clear();
+        _unindexedBatch->Clear();
+        _writeBatchIndexed = !_indexWritesLazily;
+    }
 
     void RocksRecoveryUnit::setOplogReadTill(const RecordId& record) { _oplogReadTill = record; }
 
@@ -316,6 +629,8 @@ namespace mongo {
             _snapshot = nullptr;
         }
         _snapshotHolder.reset();
+        _sharedSnapshot.reset();
+        _retiredSharedSnapshot.reset();
 
         _mySnapshotId = nextSnapshotId.fetchAndAdd(1);
     }
@@ -331,12 +646,11 @@ namespace mongo {
     }
 
     void RocksRecoveryUnit::_commit() {
-        rocksdb::WriteBatch* wb = _writeBatch.GetWriteBatch();
-        for (auto pair : _deltaCounters) {
-            auto& counter = pair.second;
+        rocksdb::WriteBatch* wb = _activeWriteBatch();
+        for (auto& counter : _deltaCounters) {
             counter._value->fetch_add(counter._delta, std::memory_order::memory_order_relaxed);
             long long newValue = counter._value->load(std::memory_order::memory_order_relaxed);
-            _counterManager->updateCounter(pair.first, newValue, wb);
+            _counterManager->updateCounter(counter._key, newValue, wb);
         }
 
         if (wb->Count() != 0) {
@@ -347,9 +661,18 @@ namespace mongo {
             auto status = _db->Write(writeOptions, wb);
             invariantRocksOK(status);
             _transaction.commit();
+            // later reads from a shared snapshot, by us or by the client's next operations, still
+            // need to see this write
+            _lastCommitSequenceNumber = _db->GetLatestSequenceNumber();
+            if (_client) {
+                auto& clientSequenceNumber = clientLastCommitSequenceNumber(_client);
+                clientSequenceNumber =
+                    std::max(clientSequenceNumber, _lastCommitSequenceNumber);
+            }
         }
         _deltaCounters.clear();
-        _writeBatch.Clear();
+        _clearWriteBatch();
+        _deletedRanges.clear();
     }
 
     void RocksRecoveryUnit::_abort() {
@@ -367,7 +690,8 @@ namespace mongo {
         }
 
         _deltaCounters.clear();
-        _writeBatch.Clear();
+        _clearWriteBatch();
+        _deletedRanges.clear();
 
         _releaseSnapshot();
     }
@@ -389,6 +713,24 @@ namespace mongo {
             }
             return _snapshotHolder->snapshot;
         }
+        if (_sharedSnapshot) {
+            return _sharedSnapshot->snapshot;
+        }
+        // Oplog readers can't use a shared snapshot: it may have been taken before the oplog
+        // read limit, and as oplog entries commit out of order, it could miss an entry below the
+        // limit while holding a later one, which the reader then skips for good.
+        if (!_snapshot && !_inUnitOfWork && _oplogReadTill.isNull() &&
+            rocksGlobalOptions.sharedSnapshotMaxAgeMillis > 0) {
+            // Outside of a unit of work we only read, so we don't need our own snapshot
+            uint64_t minSequenceNumber = _lastCommitSequenceNumber;
+            if (_client) {
+                minSequenceNumber =
+                    std::max(minSequenceNumber, clientLastCommitSequenceNumber(_client));
+            }
+            _sharedSnapshot = _snapshotManager->getSharedSnapshot(
+                _db, minSequenceNumber, rocksGlobalOptions.sharedSnapshotMaxAgeMillis);
+            return _sharedSnapshot->snapshot;
+        }
         if (!_snapshot) {
             // RecoveryUnit might be used for writing, so we need to call recordSnapshotId().
             // Order of operations here is important. It needs to be synchronized with
@@ -401,8 +743,16 @@ namespace mongo {
 
     rocksdb::Status RocksRecoveryUnit::Get(rocksdb::ColumnFamilyHandle* cfHandle,
                                            const rocksdb::Slice& key, std::string* value) {
-        if (_writeBatch.GetWriteBatch()->Count() > 0) {
-            std::unique_ptr<rocksdb::WBWIIterator> wb_iterator(_writeBatch.NewIterator());
+        if (hasPendingWrites()) {
+            _indexWriteBatch();
+        }
+        if (cfHandle == nullptr && hasPendingWrites() && _deletedRanges.empty()) {
+            rocksdb::ReadOptions options;
+            options.snapshot = snapshot();
+            return _writeBatch->GetFromBatchAndDB(_db, options, key, value);
+        }
+        if (hasPendingWrites()) {
+            std::unique_ptr<rocksdb::WBWIIterator> wb_iterator(_writeBatch->NewIterator());
             wb_iterator->Seek(key);
             if (wb_iterator->Valid() && wb_iterator->Entry().key == key) {
                 const auto& entry = wb_iterator->Entry();
@@ -413,6 +763,9 @@ namespace mongo {
                 return rocksdb::Status::OK();
             }
         }
+        if (!_deletedRanges.empty() && _inDeletedRange(cfHandle, key)) {
+            return rocksdb::Status::NotFound();
+        }
         rocksdb::ReadOptions options;
         options.snapshot = snapshot();
         if (cfHandle) {
@@ -428,27 +781,54 @@ namespace mongo {
         rocksdb::ReadOptions options;
         options.iterate_upper_bound = upperBound.get();
         options.snapshot = snapshot();
-
-        auto iterator = (cfHandle) ?
-            _writeBatch.NewIteratorWithBase(_db->NewIterator(options, cfHandle)) :
-            _writeBatch.NewIteratorWithBase(_db->NewIterator(options));
-        auto prefixIterator = new PrefixStrippingIterator(std::move(prefix), iterator,
-                                                          isOplog ? nullptr : _compactionScheduler,
-                                                          std::move(upperBound));
+        // scans cross index key prefixes, see rocksdbIndexPrefixBloomFilter
+        options.total_order_seek = true;
+        auto lowerBound = setLowerBound(&options);
+
+        // read-only units of work skip the merge with the write batch until they write
+        rocksdb::Iterator* iterator =
+            cfHandle ? _db->NewIterator(options, cfHandle) : _db->NewIterator(options);
+        const bool merged = hasPendingWrites();
+        if (merged) {
+            iterator = wrapWithWriteBatch(iterator);
+        }
+        auto prefixIterator = new PrefixStrippingIterator(
+            std::move(prefix), iterator, isOplog ? nullptr : _compactionScheduler,
+            std::move(upperBound), std::move(lowerBound), this, cfHandle, merged);
         return prefixIterator;
     }
 
+    RocksIterator* RocksRecoveryUnit::NewPrefixSeekIterator(std::string prefix) {
+        std::unique_ptr<rocksdb::Slice> upperBound(new rocksdb::Slice());
+        rocksdb::ReadOptions options;
+        options.iterate_upper_bound = upperBound.get();
+        options.snapshot = snapshot();
+        options.prefix_same_as_start = true;
+        auto lowerBound = setLowerBound(&options);
+
+        rocksdb::Iterator* iterator = _db->NewIterator(options);
+        const bool merged = hasPendingWrites();
+        if (merged) {
+            iterator = wrapWithWriteBatch(iterator);
+        }
+        return new PrefixStrippingIterator(std::move(prefix), iterator, _compactionScheduler,
+                                           std::move(upperBound), std::move(lowerBound), this,
+                                           nullptr, merged);
+    }
+
     RocksIterator* RocksRecoveryUnit::NewIteratorNoSnapshot(rocksdb::DB* db,
                                                             rocksdb::ColumnFamilyHandle* cfHandle, std::string prefix) {
         std::unique_ptr<rocksdb::Slice> upperBound(new rocksdb::Slice());
         rocksdb::ReadOptions options;
         options.iterate_upper_bound = upperBound.get();
+        options.total_order_seek = true;
+        auto lowerBound = setLowerBound(&options);
 
         auto iterator = (cfHandle) ?
-            db->NewIterator(rocksdb::ReadOptions(), cfHandle) :
-            db->NewIterator(rocksdb::ReadOptions());
+            db->NewIterator(options, cfHandle) :
+            db->NewIterator(options);
         return new PrefixStrippingIterator(std::move(prefix), iterator, nullptr,
-                                           std::move(upperBound));
+                                           std::move(upperBound), std::move(lowerBound));
     }
 
     void RocksRecoveryUnit::incrementCounter(const rocksdb::Slice& counterKey,
@@ -457,25 +837,130 @@ namespace mongo {
             return;
         }
 
-        auto pair = _deltaCounters.find(counterKey.ToString());
-        if (pair == _deltaCounters.end()) {
-            _deltaCounters[counterKey.ToString()] =
-                mongo::RocksRecoveryUnit::Counter(counter, delta);
-        } else {
-            pair->second._delta += delta;
+        for (auto& deltaCounter : _deltaCounters) {
+            if (deltaCounter._value == counter) {
+                dassert(deltaCounter._key == counterKey);
+                deltaCounter._delta += delta;
+                return;
+            }
         }
+        _deltaCounters.emplace_back(counterKey, counter, delta);
     }
 
     long long RocksRecoveryUnit::getDeltaCounter(const rocksdb::Slice& counterKey) {
-        auto counter = _deltaCounters.find(counterKey.ToString());
-        if (counter == _deltaCounters.end()) {
-            return 0;
-        } else {
-            return counter->second._delta;
+        for (const auto& deltaCounter : _deltaCounters) {
+            if (deltaCounter._key == counterKey) {
+                return deltaCounter._delta;
+            }
+        }
+        return 0;
+    }
+
+    void RocksRecoveryUnit::deleteRange(rocksdb::ColumnFamilyHandle* cfHandle,
+                                        const rocksdb::Slice& begin, const rocksdb::Slice& end) {
+        _indexWriteBatch();
+        // Keys that we already wrote in this unit of work are deleted through the index, so that
+        // reading them back doesn't find the stale entries in the write batch
+        if (_writeBatch->GetWriteBatch()->Count() > 0) {
+            std::vector<std::string> writtenKeys;
+            std::unique_ptr<rocksdb::WBWIIterator> wbIterator(
+                cfHandle ? _writeBatch->NewIterator(cfHandle) : _writeBatch->NewIterator());
+            for (wbIterator->Seek(begin);
+                 wbIterator->Valid() && wbIterator->Entry().key.compare(end) < 0;
+                 wbIterator->Next()) {
+                if (wbIterator->Entry().type != rocksdb::WriteType::kDeleteRecord) {
+                    writtenKeys.push_back(wbIterator->Entry().key.ToString());
+                }
+            }
+            for (const auto& key : writtenKeys) {
+                _writeBatch->Delete(cfHandle, key);
+            }
+        }
+
+#if ROCKSDB_MAJOR >= 5
+        // WriteBatchWithIndex doesn't support DeleteRange(), so we append the range deletion
+        // directly to the underlying batch. It is applied in order with the rest of the batch on
+        // commit.
+        auto batch = _writeBatch->GetWriteBatch();
+        auto s = cfHandle ? batch->DeleteRange(cfHandle, begin, end)
+                          : batch->DeleteRange(begin, end);
+        invariantRocksOK(s);
+#else
+        // no range deletions, fall back to deleting the keys one by one
+        rocksdb::ReadOptions options;
+        options.snapshot = snapshot();
+        options.total_order_seek = true;
+        std::unique_ptr<rocksdb::Iterator> iterator(
+            cfHandle ? _db->NewIterator(options, cfHandle) : _db->NewIterator(options));
+        for (iterator->Seek(begin); iterator->Valid() && iterator->key().compare(end) < 0;
+             iterator->Next()) {
+            _writeBatch->GetWriteBatch()->Delete(cfHandle, iterator->key());
+        }
+        invariantRocksOK(iterator->status());
+#endif
+        _addDeletedRange(columnFamilyId(cfHandle), begin.ToString(), end.ToString());
+    }
+
+    void RocksRecoveryUnit::_addDeletedRange(uint32_t cfId, std::string begin, std::string end) {
+        // _deletedRanges stays sorted and free of overlaps, so we merge the new range with every
+        // range it touches
+        auto it = std::upper_bound(_deletedRanges.begin(), _deletedRanges.end(),
+                                   std::make_pair(cfId, rocksdb::Slice(begin)), RangeBeginLess());
+        if (it != _deletedRanges.begin()) {
+            auto prev = it - 1;
+            if (prev->cfId == cfId && prev->end >= begin) {
+                begin = std::move(prev->begin);
+                if (prev->end > end) {
+                    end = std::move(prev->end);
+                }
+                it = _deletedRanges.erase(prev);
+            }
+        }
+        while (it != _deletedRanges.end() && it->cfId == cfId && it->begin <= end) {
+            if (it->end > end) {
+                end = std::move(it->end);
+            }
+            it = _deletedRanges.erase(it);
+        }
+        _deletedRanges.insert(it, {cfId, std::move(begin), std::move(end)});
+    }
+
+    bool RocksRecoveryUnit::isDeletedByRange(rocksdb::ColumnFamilyHandle* cfHandle,
+                                             const rocksdb::Slice& key) {
+        if (!_inDeletedRange(cfHandle, key)) {
+            return false;
+        }
+        // deleteRange() turned all of the earlier writes into deletes, so anything else we find
+        // in the write batch was written after the range got deleted. Iterators call this for
+        // every key they step over, so we keep one write batch iterator around.
+        const uint32_t cfId = columnFamilyId(cfHandle);
+        if (!_rangeCheckIterator || _rangeCheckIteratorCfId != cfId) {
+            _rangeCheckIterator.reset(cfHandle ? _writeBatch->NewIterator(cfHandle)
+                                               : _writeBatch->NewIterator());
+            _rangeCheckIteratorCfId = cfId;
+        }
+        _rangeCheckIterator->Seek(key);
+        return !(_rangeCheckIterator->Valid() && _rangeCheckIterator->Entry().key == key &&
+                 _rangeCheckIterator->Entry().type != rocksdb::WriteType::kDeleteRecord);
+    }
+
+    bool RocksRecoveryUnit::_inDeletedRange(rocksdb::ColumnFamilyHandle* cfHandle,
+                                            const rocksdb::Slice& key) const {
+        const uint32_t cfId = columnFamilyId(cfHandle);
+        // the last range that begins at or before the key is the only one that can contain it
+        auto it = std::upper_bound(_deletedRanges.begin(), _deletedRanges.end(),
+                                   std::make_pair(cfId, key), RangeBeginLess());
+        if (it == _deletedRanges.begin()) {
+            return false;
         }
+        --it;
+        return it->cfId == cfId && key.compare(it->end) < 0;
     }
 
     RocksRecoveryUnit* RocksRecoveryUnit::getRocksRecoveryUnit(OperationContext* opCtx) {
-        return checked_cast<RocksRecoveryUnit*>(opCtx->recoveryUnit());
+        auto ru = checked_cast<RocksRecoveryUnit*>(opCtx->recoveryUnit());
+        // the client whose writes our shared snapshots have to see
+        ru->_client = opCtx->getClient();
+        return ru;
     }
 }
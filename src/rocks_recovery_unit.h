@@ -31,6 +31,7 @@
 #include <atomic>
 #include <map>
 #include <stack>
+#include <memory>
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -40,6 +41,7 @@
 
 #include <rocksdb/slice.h>
 #include <rocksdb/write_batch.h>
+#include <rocksdb/write_batch_base.h>
 #include <rocksdb/utilities/write_batch_with_index.h>
 
 #include "mongo/base/disallow_copying.h"
@@ -74,8 +76,16 @@ namespace mongo {
         // This Seek is specific because it will succeed only if it finds a key with `target`
         // prefix. If there is no such key, it will be !Valid()
         virtual void SeekPrefix(const rocksdb::Slice& target) = 0;
+
+        // Narrows what RocksDB reads to keys in [lower, upper) (both without the prefix), so that
+        // scans stop at the bound instead of reading into the next blocks and files. An empty
+        // slice means the start or the end of the prefix. Applies to the following positioning
+        // calls. Entries that are only in the write batch aren't bounded, so callers still have
+        // to check the keys they get.
+        virtual void setBounds(const rocksdb::Slice& lower, const rocksdb::Slice& upper) = 0;
     };
 
+    class Client;
     class OperationContext;
 
     class RocksRecoveryUnit : public RecoveryUnit {
@@ -85,7 +95,8 @@ namespace mongo {
                           RocksSnapshotManager* snapshotManager, rocksdb::DB* db,
                           RocksCounterManager* counterManager,
                           RocksCompactionScheduler* compactionScheduler,
-                          RocksDurabilityManager* durabilityManager, bool durable);
+                          RocksDurabilityManager* durabilityManager, bool durable,
+                          bool indexWritesLazily = false);
         virtual ~RocksRecoveryUnit();
 
         virtual void beginUnitOfWork(OperationContext* opCtx);
@@ -113,7 +124,14 @@ namespace mongo {
 
         // local api
 
-        rocksdb::WriteBatchWithIndex* writeBatch();
+        // Where the unit of work's writes go. With indexWritesLazily that is a plain WriteBatch
+        // until the unit of work first reads its own writes.
+        rocksdb::WriteBatchBase* writeBatch();
+
+        bool hasPendingWrites() { return _activeWriteBatch()->Count() > 0; }
+
+        // Returns an iterator over base merged with the write batch. base is consumed.
+        rocksdb::Iterator* wrapWithWriteBatch(rocksdb::Iterator* base);
 
         const rocksdb::Snapshot* getPreparedSnapshot();
         void dbReleaseSnapshot(const rocksdb::Snapshot* snapshot);
@@ -121,7 +139,10 @@ namespace mongo {
         // Returns snapshot, creating one if needed. Considers _readFromMajorityCommittedSnapshot.
         const rocksdb::Snapshot* snapshot();
 
-        bool hasSnapshot() { return _snapshot != nullptr || _snapshotHolder.get() != nullptr; }
+        bool hasSnapshot() {
+            return _snapshot != nullptr || _snapshotHolder.get() != nullptr ||
+                   _sharedSnapshot.get() != nullptr;
+        }
 
         RocksTransaction* transaction() { return &_transaction; }
 
@@ -137,34 +158,67 @@ namespace mongo {
         RocksIterator* NewIterator(rocksdb::ColumnFamilyHandle* cfHandle,
                                    std::string prefix, bool isOplog = false);
 
+        // Iterator in prefix seek mode: it only returns keys that share the index key prefix
+        // (see rocksdbIndexPrefixBloomFilter) of the key it was positioned with by Seek(), which
+        // lets prefix bloom filters skip files and blocks. Only Seek() followed by Next() is
+        // supported. Without a prefix extractor it behaves like NewIterator().
+        RocksIterator* NewPrefixSeekIterator(std::string prefix);
+
         static RocksIterator* NewIteratorNoSnapshot(rocksdb::DB* db, std::string prefix) {
             return NewIteratorNoSnapshot(db, nullptr, prefix);
         }
         static RocksIterator* NewIteratorNoSnapshot(rocksdb::DB* db,
                                                     rocksdb::ColumnFamilyHandle* cfHandle, std::string prefix);
 
+        // counterKey has to stay valid until the unit of work ends. A counter is identified by
+        // its value, so each counter has to be updated with the same key.
         void incrementCounter(const rocksdb::Slice& counterKey,
                               std::atomic<long long>* counter, long long delta);
 
         long long getDeltaCounter(const rocksdb::Slice& counterKey);
 
+        // Deletes all keys in [begin, end) as part of this unit of work without reading them.
+        // Reads through this recovery unit don't see the deleted keys, unless they are written
+        // again after the deletion. No write conflicts are registered for the deleted keys, so
+        // the caller must make sure nobody else is writing to the range (e.g. by holding an
+        // exclusive collection lock).
+        void deleteRange(rocksdb::ColumnFamilyHandle* cfHandle, const rocksdb::Slice& begin,
+                         const rocksdb::Slice& end);
+
+        bool hasRangeDeletions() const { return !_deletedRanges.empty(); }
+
+        // Returns true if the key was deleted by deleteRange() and not written again since
+        bool isDeletedByRange(rocksdb::ColumnFamilyHandle* cfHandle, const rocksdb::Slice& key);
+
         void setOplogReadTill(const RecordId& loc);
         RecordId getOplogReadTill() const { return _oplogReadTill; }
 
         RocksRecoveryUnit* newRocksRecoveryUnit() {
             return new RocksRecoveryUnit(_transactionEngine, _snapshotManager, _db, _counterManager,
-                                         _compactionScheduler, _durabilityManager, _durable);
+                                         _compactionScheduler, _durabilityManager, _durable,
+                                         _indexWritesLazily);
         }
 
         struct Counter {
+            rocksdb::Slice _key;  // not owned
             std::atomic<long long>* _value;
             long long _delta;
-            Counter() : Counter(nullptr, 0) {}
-            Counter(std::atomic<long long>* value, long long delta) : _value(value),
-                                                                      _delta(delta) {}
+            Counter() : Counter(rocksdb::Slice(), nullptr, 0) {}
+            Counter(rocksdb::Slice key, std::atomic<long long>* value, long long delta)
+                : _key(key), _value(value), _delta(delta) {}
         };
 
-        typedef std::unordered_map<std::string, Counter> CounterMap;
+        // A unit of work touches few counters, a couple per collection it writes, so they're
+        // searched linearly instead of hashing (and copying) their keys
+        typedef std::vector<Counter> CounterMap;
+
+        // What a recovery unit hands to the next one when it's destroyed, see PooledBuffersPool
+        struct PooledBuffers {
+            std::unique_ptr<rocksdb::WriteBatchWithIndex> writeBatch;
+            std::unique_ptr<rocksdb::WriteBatch> unindexedBatch;
+            CounterMap deltaCounters;
+            std::vector<Change*> changes;
+        };
 
         static RocksRecoveryUnit* getRocksRecoveryUnit(OperationContext* opCtx);
 
@@ -182,6 +236,24 @@ namespace mongo {
         void _commit();
 
         void _abort();
+
+        // Returns true if the key falls into one of _deletedRanges. Doesn't consult the write
+        // batch.
+        bool _inDeletedRange(rocksdb::ColumnFamilyHandle* cfHandle,
+                             const rocksdb::Slice& key) const;
+
+        void _addDeletedRange(uint32_t cfId, std::string begin, std::string end);
+
+        rocksdb::WriteBatch* _activeWriteBatch() {
+            return _writeBatchIndexed ? _writeBatch->GetWriteBatch() : _unindexedBatch.get();
+        }
+
+        // Moves the writes of _unindexedBatch into _writeBatch, which is used from then on until
+        // the unit of work ends
+        void _indexWriteBatch();
+
+        void _clearWriteBatch();
+
         RocksTransactionEngine* _transactionEngine;      // not owned
         RocksSnapshotManager* _snapshotManager;          // not owned
         rocksdb::DB* _db;                                // not owned
@@ -190,10 +262,18 @@ namespace mongo {
         RocksDurabilityManager* _durabilityManager;      // not owned
 
         const bool _durable;
+        // only for engines with a single column family
+        const bool _indexWritesLazily;
 
         RocksTransaction _transaction;
 
-        rocksdb::WriteBatchWithIndex _writeBatch;
+        // Comes from and goes back to a pool shared by all recovery units, and so do the write
+        // batches, _deltaCounters and _changes, which are moved out of it while we live
+        std::unique_ptr<PooledBuffers> _pooledBuffers;
+        std::unique_ptr<rocksdb::WriteBatchWithIndex> _writeBatch;
+        // holds the writes while !_writeBatchIndexed
+        std::unique_ptr<rocksdb::WriteBatch> _unindexedBatch;
+        bool _writeBatchIndexed;
 
         // bare because we need to call ReleaseSnapshot when we're done with this
         const rocksdb::Snapshot* _snapshot; // owned
@@ -204,6 +284,27 @@ namespace mongo {
 
         CounterMap _deltaCounters;
 
+        // Ranges deleted by deleteRange() in this unit of work. The deletions themselves are in
+        // the write batch, but WriteBatchWithIndex can't index range deletions, so we need to
+        // filter the keys ourselves when reading. Sorted by (cfId, begin), with overlapping
+        // ranges merged.
+        struct DeletedRange {
+            uint32_t cfId;
+            std::string begin;
+            std::string end;
+        };
+        struct RangeBeginLess {
+            bool operator()(const std::pair<uint32_t, rocksdb::Slice>& key,
+                            const DeletedRange& range) const {
+                return key.first < range.cfId ||
+                       (key.first == range.cfId && key.second.compare(range.begin) < 0);
+            }
+        };
+        std::vector<DeletedRange> _deletedRanges;
+        // reused by isDeletedByRange(), reset together with the write batch
+        std::unique_ptr<rocksdb::WBWIIterator> _rangeCheckIterator;
+        uint32_t _rangeCheckIteratorCfId;
+
         typedef OwnedPointerVector<Change> Changes;
         Changes _changes;
 
@@ -217,8 +318,21 @@ namespace mongo {
         // should be shared here to ensure that it is not released early
         std::shared_ptr<RocksSnapshotManager::SnapshotHolder> _snapshotHolder;
 
+        // Shared with other readers, only used outside of units of work. See
+        // RocksGlobalOptions::sharedSnapshotMaxAgeMillis.
+        std::shared_ptr<RocksSnapshotManager::SnapshotHolder> _sharedSnapshot;
+        // The shared snapshot we read from before the unit of work began, kept alive for the
+        // cursors that still read from it
+        std::shared_ptr<RocksSnapshotManager::SnapshotHolder> _retiredSharedSnapshot;
+        // Sequence number after our last commit. A shared snapshot has to be at least as new.
+        uint64_t _lastCommitSequenceNumber = 0;
+        // Client of the operation we're used by. Our commits advance its last commit sequence
+        // number, and our shared snapshots have to be at least as new.
+        Client* _client = nullptr;
+
         bool _readFromMajorityCommittedSnapshot = false;
         bool _areWriteUnitOfWorksBanned = false;
+        bool _inUnitOfWork = false;
     };
 
 }
@@ -49,8 +49,10 @@
 #include "mongo/util/scopeguard.h"
 #include "mongo/util/mongoutils/str.h"
 
+#include "rocks_durability_manager.h"
 #include "rocks_recovery_unit.h"
 #include "rocks_engine.h"
+#include "rocks_record_store.h"
 #include "rocks_transaction.h"
 
 #define ROCKS_TRACE log()
@@ -157,6 +159,14 @@ namespace mongo {
                    static_cast<long long>(_engine->getTransactionEngine()->numKeysTracked()));
         bob.append("transaction-engine-snapshots",
                    static_cast<long long>(_engine->getTransactionEngine()->numActiveSnapshots()));
+        if (_engine->getIdCache()) {
+            BSONObjBuilder idCacheBuilder(bob.subobjStart("id-cache"));
+            _engine->getIdCache()->appendStats(&idCacheBuilder);
+        }
+        {
+            BSONArrayBuilder compactions(bob.subarrayStart("compactions"));
+            _engine->getCompactionScheduler()->appendCompactionTasks(&compactions);
+        }
 
         std::vector<rocksdb::ThreadStatus> threadList;
         auto s = rocksdb::Env::Default()->GetThreadList(&threadList);
@@ -234,7 +244,11 @@ namespace mongo {
             {rocksdb::ITER_BYTES_READ, "bytes-read-iteration"},
             {rocksdb::FLUSH_WRITE_BYTES, "flush-bytes-written"},
             {rocksdb::COMPACT_READ_BYTES, "compaction-bytes-read"},
-            {rocksdb::COMPACT_WRITE_BYTES, "compaction-bytes-written"}
+            {rocksdb::COMPACT_WRITE_BYTES, "compaction-bytes-written"},
+            // commits written by their own thread (as the leader of a write group) and by
+            // another thread's group
+            {rocksdb::WRITE_DONE_BY_SELF, "writes-done-by-self"},
+            {rocksdb::WRITE_DONE_BY_OTHER, "writes-done-by-other"}
           };
 
           for (const auto& counter_name : counterNameMap) {
@@ -265,6 +279,19 @@ namespace mongo {
 	    }
         }
 
+        {
+            BSONObjBuilder snapshotsBuilder(bob.subobjStart("majority-snapshots"));
+            checked_cast<RocksSnapshotManager*>(_engine->getSnapshotManager())
+                ->appendStats(&snapshotsBuilder);
+            snapshotsBuilder.done();
+        }
+
+        {
+            BSONObjBuilder walSyncBuilder(bob.subobjStart("wal-syncs"));
+            _engine->getDurabilityManager()->appendSyncStats(&walSyncBuilder);
+            walSyncBuilder.done();
+        }
+
         RocksEngine::appendGlobalStats(bob);
         return bob.obj();
     }
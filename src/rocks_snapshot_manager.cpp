@@ -33,10 +33,16 @@
 #include "rocks_snapshot_manager.h"
 #include "rocks_recovery_unit.h"
 
+#include <algorithm>
+
 #include <rocksdb/db.h>
 
 #include "mongo/base/checked_cast.h"
+#include "mongo/bson/bsonobjbuilder.h"
 #include "mongo/util/log.h"
+#include "mongo/util/time_support.h"
+
+#include "rocks_global_options.h"
 
 namespace mongo {
     // This only checks invariants
@@ -50,6 +56,8 @@ namespace mongo {
         uint64_t nameU64 = name.asU64();
         _snapshotMap[nameU64] = std::make_shared<SnapshotHolder>(opCtx, nameU64);
         _snapshots.push_back(nameU64);
+        _dropOldSnapshots_inlock();
+        _dropSnapshotsOverLimit_inlock();
         return Status::OK();
     }
 
@@ -58,11 +66,57 @@ namespace mongo {
 
         uint64_t nameU64 = name.asU64();
         invariant(!_committedSnapshot || *_committedSnapshot < nameU64);
+        if (_snapshotMap.find(nameU64) == _snapshotMap.end()) {
+            // It was released for its age. An older snapshot would miss writes that are majority
+            // committed, so majority reads fail until a snapshot we still have is committed.
+            warning() << "Majority committed snapshot " << nameU64 << " was released because it "
+                      << "was older than " << rocksGlobalOptions.maxMajoritySnapshotAgeSecs
+                      << "s. Majority reads fail until a newer snapshot is majority committed.";
+            _committedSnapshot = boost::none;
+            return;
+        }
         _committedSnapshot = nameU64;
     }
 
+    void RocksSnapshotManager::_dropSnapshot_inlock(size_t index) {
+        const uint64_t name = _snapshots[index];
+        invariant(_snapshotMap.erase(name) == 1);
+        _snapshots.erase(_snapshots.begin() + index);
+        if (_committedSnapshot && *_committedSnapshot == name) {
+            warning() << "Releasing the majority committed snapshot because it is older than "
+                      << rocksGlobalOptions.maxMajoritySnapshotAgeSecs
+                      << "s. Majority reads fail until a newer snapshot is majority committed.";
+            _committedSnapshot = boost::none;
+        }
+    }
+
+    void RocksSnapshotManager::_dropOldSnapshots_inlock() {
+        const int maxAgeSecs = rocksGlobalOptions.maxMajoritySnapshotAgeSecs;
+        if (maxAgeSecs <= 0) {
+            return;
+        }
+        const unsigned long long now = curTimeMillis64();
+        // keep the newest snapshot, it's the next one to become majority committed
+        while (_snapshots.size() > 1 &&
+               _snapshotMap.at(_snapshots.front())->createdMillis + maxAgeSecs * 1000ULL < now) {
+            _dropSnapshot_inlock(0);
+        }
+    }
+
+    void RocksSnapshotManager::_dropSnapshotsOverLimit_inlock() {
+        const size_t maxSnapshots = std::max(rocksGlobalOptions.maxMajoritySnapshots, 0);
+        // The majority commit point only moves forward, so only the snapshots older than the
+        // committed one can't be committed anymore. Releasing any other snapshot would make
+        // majority reads miss majority committed writes, so they all stay.
+        while (maxSnapshots > 0 && _snapshots.size() > maxSnapshots && _committedSnapshot &&
+               _snapshots.front() < *_committedSnapshot) {
+            _dropSnapshot_inlock(0);
+        }
+    }
+
     void RocksSnapshotManager::cleanupUnneededSnapshots() {
         stdx::lock_guard<stdx::mutex> lock(_mutex);
+        _dropOldSnapshots_inlock();
         if (!_committedSnapshot) {
             return;
         }
@@ -79,10 +133,14 @@ namespace mongo {
     }
 
     void RocksSnapshotManager::dropAllSnapshots() {
-        stdx::lock_guard<stdx::mutex> lock(_mutex);
-        _committedSnapshot = boost::none;
-        _snapshotMap.clear();
-        _snapshots.clear();
+        {
+            stdx::lock_guard<stdx::mutex> lock(_mutex);
+            _committedSnapshot = boost::none;
+            _snapshotMap.clear();
+            _snapshots.clear();
+        }
+        stdx::lock_guard<stdx::mutex> lock(_sharedSnapshotMutex);
+        _sharedSnapshot.reset();
     }
 
     bool RocksSnapshotManager::haveCommittedSnapshot() const {
@@ -100,11 +158,48 @@ namespace mongo {
         return _snapshotMap.at(*_committedSnapshot);
     }
 
+    void RocksSnapshotManager::appendStats(BSONObjBuilder* builder) const {
+        stdx::lock_guard<stdx::mutex> lock(_mutex);
+        builder->append("count", static_cast<long long>(_snapshots.size()));
+        builder->append("committed", bool(_committedSnapshot));
+        if (_snapshots.empty()) {
+            return;
+        }
+        const auto& oldest = _snapshotMap.at(_snapshots.front());
+        const unsigned long long now = curTimeMillis64();
+        builder->append("oldest-age-secs",
+                        static_cast<long long>(now > oldest->createdMillis
+                                                   ? (now - oldest->createdMillis) / 1000
+                                                   : 0));
+        builder->append("oldest-writes-behind",
+                        static_cast<long long>(oldest->db->GetLatestSequenceNumber() -
+                                               oldest->snapshot->GetSequenceNumber()));
+    }
+
+    std::shared_ptr<RocksSnapshotManager::SnapshotHolder> RocksSnapshotManager::getSharedSnapshot(
+        rocksdb::DB* db, uint64_t minSequenceNumber, int maxAgeMillis) {
+        const unsigned long long now = curTimeMillis64();
+        stdx::lock_guard<stdx::mutex> lock(_sharedSnapshotMutex);
+        if (!_sharedSnapshot ||
+            _sharedSnapshot->snapshot->GetSequenceNumber() < minSequenceNumber ||
+            now >= _sharedSnapshotTakenMillis + maxAgeMillis) {
+            // readers that still use the old snapshot keep it alive
+            _sharedSnapshot = std::make_shared<SnapshotHolder>(db, db->GetSnapshot());
+            _sharedSnapshotTakenMillis = now;
+        }
+        return _sharedSnapshot;
+    }
+
+    RocksSnapshotManager::SnapshotHolder::SnapshotHolder(rocksdb::DB* db_,
+                                                         const rocksdb::Snapshot* snapshot_)
+        : name(0), snapshot(snapshot_), db(db_), createdMillis(curTimeMillis64()) {}
+
     RocksSnapshotManager::SnapshotHolder::SnapshotHolder(OperationContext* opCtx, uint64_t name_) {
         name = name_;
         auto rru = RocksRecoveryUnit::getRocksRecoveryUnit(opCtx);
         snapshot = rru->getPreparedSnapshot();
         db = rru->getDB();
+        createdMillis = curTimeMillis64();
     }
 
     RocksSnapshotManager::SnapshotHolder::~SnapshotHolder() {
@@ -39,6 +39,7 @@
 
 namespace mongo {
 
+class BSONObjBuilder;
 class RocksRecoveryUnit;
 
 class RocksSnapshotManager final : public SnapshotManager {
@@ -49,7 +50,10 @@ public:
         uint64_t name;
         const rocksdb::Snapshot* snapshot;
         rocksdb::DB* db;
+        unsigned long long createdMillis;
         SnapshotHolder(OperationContext* opCtx, uint64_t name_);
+        // takes ownership of snapshot_
+        SnapshotHolder(rocksdb::DB* db_, const rocksdb::Snapshot* snapshot_);
         ~SnapshotHolder();
     };
 
@@ -71,13 +75,31 @@ public:
 
     bool haveCommittedSnapshot() const;
 
+    // Appends the number of snapshots kept for majority reads, and the age of the oldest one and
+    // the number of writes since it, which bounds the versions it holds back
+    void appendStats(BSONObjBuilder* builder) const;
+
     std::shared_ptr<RocksSnapshotManager::SnapshotHolder> getCommittedSnapshot() const;
 
+    // Returns a snapshot of db shared with other readers. It is at most maxAgeMillis old and
+    // includes every write up to minSequenceNumber; if the current one isn't, a new one is taken.
+    std::shared_ptr<RocksSnapshotManager::SnapshotHolder> getSharedSnapshot(
+        rocksdb::DB* db, uint64_t minSequenceNumber, int maxAgeMillis);
+
 private:
+    // Enforce rocksGlobalOptions.maxMajoritySnapshotAgeSecs and maxMajoritySnapshots
+    void _dropOldSnapshots_inlock();
+    void _dropSnapshotsOverLimit_inlock();
+    void _dropSnapshot_inlock(size_t index);
+
     std::vector<uint64_t> _snapshots;  // sorted
     std::unordered_map<uint64_t, std::shared_ptr<SnapshotHolder>> _snapshotMap;
     boost::optional<uint64_t> _committedSnapshot;
 
-    mutable stdx::mutex _mutex;  // Guards all members
+    mutable stdx::mutex _mutex;  // Guards all members above
+
+    stdx::mutex _sharedSnapshotMutex;  // Guards the members below
+    std::shared_ptr<SnapshotHolder> _sharedSnapshot;
+    unsigned long long _sharedSnapshotTakenMillis = 0;
 };
 } // namespace mongo
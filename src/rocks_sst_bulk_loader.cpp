@@ -0,0 +1,209 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_sst_bulk_loader.h"
+
+#include <algorithm>
+#include <memory>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <rocksdb/env.h>
+#include <rocksdb/options.h>
+#include <rocksdb/sst_file_writer.h>
+#include <rocksdb/version.h>
+
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+
+#include "rocks_util.h"
+
+#if ROCKSDB_MAJOR >= 5
+#define ROCKS_HAVE_INGEST_EXTERNAL_FILE 1
+#endif
+
+namespace mongo {
+
+    namespace {
+        const std::string kTempDirPrefix = "_bulk_load_";
+    }  // namespace
+
+    RocksSstBulkLoader::RocksSstBulkLoader(rocksdb::DB* db, const std::string& name)
+        : _db(db),
+          _options(db->GetOptions()),
+          _dir(db->GetName() + "/" + kTempDirPrefix + name) {
+        // idents can contain directory separators with directoryPerDB
+        std::replace(_dir.begin() + db->GetName().size() + 1, _dir.end(), '/', '_');
+    }
+
+    RocksSstBulkLoader::~RocksSstBulkLoader() {
+        _joinWriters(0);
+        if (_dirCreated) {
+            boost::system::error_code ec;
+            boost::filesystem::remove_all(_dir, ec);
+            if (ec) {
+                warning() << "failed to remove bulk load directory " << _dir << ": "
+                          << ec.message();
+            }
+        }
+    }
+
+    bool RocksSstBulkLoader::isSupported() {
+#ifdef ROCKS_HAVE_INGEST_EXTERNAL_FILE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void RocksSstBulkLoader::removeLeftovers(const std::string& dbPath) {
+        boost::system::error_code ec;
+        for (boost::filesystem::directory_iterator it(dbPath, ec), end; !ec && it != end;
+             it.increment(ec)) {
+            const std::string name = it->path().filename().string();
+            if (name.compare(0, kTempDirPrefix.size(), kTempDirPrefix) == 0) {
+                log() << "removing leftover bulk load directory " << it->path().string();
+                boost::system::error_code removeEc;
+                boost::filesystem::remove_all(it->path(), removeEc);
+            }
+        }
+    }
+
+    Status RocksSstBulkLoader::add(const rocksdb::Slice& key, const rocksdb::Slice& value) {
+        _current.data.append(key.data(), key.size());
+        _current.data.append(value.data(), value.size());
+        _current.sizes.emplace_back(static_cast<uint32_t>(key.size()),
+                                    static_cast<uint32_t>(value.size()));
+        if (_current.data.size() >= kPartitionBytes) {
+            _flushPartition();
+            return _getStatus();
+        }
+        return Status::OK();
+    }
+
+    Status RocksSstBulkLoader::ingest() {
+        if (!_current.sizes.empty()) {
+            _flushPartition();
+        }
+        _joinWriters(0);
+        Status status = _getStatus();
+        if (!status.isOK() || _files.empty()) {
+            return status;
+        }
+
+#ifdef ROCKS_HAVE_INGEST_EXTERNAL_FILE
+        rocksdb::IngestExternalFileOptions options;
+        // the files are ours, link them into the DB instead of copying
+        options.move_files = true;
+        options.allow_global_seqno = true;
+        options.allow_blocking_flush = true;
+        LOG(1) << "ingesting " << _files.size() << " files from " << _dir;
+        return rocksToMongoStatus(_db->IngestExternalFile(_files, options));
+#else
+        return Status(ErrorCodes::CommandNotSupported,
+                      "ingesting external files requires RocksDB 5.0 or newer");
+#endif
+    }
+
+    void RocksSstBulkLoader::_flushPartition() {
+        if (!_dirCreated) {
+            boost::system::error_code ec;
+            boost::filesystem::create_directories(_dir, ec);
+            if (ec) {
+                stdx::lock_guard<stdx::mutex> lk(_statusMutex);
+                _status = Status(ErrorCodes::InternalError,
+                                 str::stream() << "failed to create bulk load directory " << _dir
+                                               << ": " << ec.message());
+                _current = Partition();
+                return;
+            }
+            _dirCreated = true;
+        }
+
+        // keep at most kMaxWriterThreads partitions in flight
+        _joinWriters(kMaxWriterThreads - 1);
+
+        std::string path = str::stream() << _dir << "/" << _files.size() << ".sst";
+        _files.push_back(path);
+        auto partition = std::make_shared<Partition>(std::move(_current));
+        _current = Partition();
+        _writers.emplace_back([this, path, partition] {
+            auto s = _writeFile(_options, path, *partition);
+            if (!s.ok()) {
+                stdx::lock_guard<stdx::mutex> lk(_statusMutex);
+                if (_status.isOK()) {
+                    _status = rocksToMongoStatus(s);
+                }
+            }
+        });
+    }
+
+    void RocksSstBulkLoader::_joinWriters(size_t maxRunning) {
+        while (_writers.size() > maxRunning) {
+            _writers.front().join();
+            _writers.pop_front();
+        }
+    }
+
+    Status RocksSstBulkLoader::_getStatus() {
+        stdx::lock_guard<stdx::mutex> lk(_statusMutex);
+        return _status;
+    }
+
+    rocksdb::Status RocksSstBulkLoader::_writeFile(const rocksdb::Options& options,
+                                                   const std::string& path,
+                                                   const Partition& partition) {
+#ifdef ROCKS_HAVE_INGEST_EXTERNAL_FILE
+        rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), options);
+        auto s = writer.Open(path);
+        size_t offset = 0;
+        for (size_t i = 0; s.ok() && i < partition.sizes.size(); ++i) {
+            rocksdb::Slice key(partition.data.data() + offset, partition.sizes[i].first);
+            offset += partition.sizes[i].first;
+            rocksdb::Slice value(partition.data.data() + offset, partition.sizes[i].second);
+            offset += partition.sizes[i].second;
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 14)
+            s = writer.Put(key, value);
+#else
+            s = writer.Add(key, value);
+#endif
+        }
+        if (s.ok()) {
+            s = writer.Finish();
+        }
+        return s;
+#else
+        return rocksdb::Status::NotSupported("SstFileWriter");
+#endif
+    }
+
+}  // namespace mongo
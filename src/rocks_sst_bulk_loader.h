@@ -0,0 +1,104 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <rocksdb/db.h>
+#include <rocksdb/slice.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/base/status.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/stdx/thread.h"
+
+namespace mongo {
+
+    /**
+     * Loads a stream of sorted keys into the DB by writing them into SST files and ingesting
+     * those, instead of going through the WAL and the memtable. Keys are buffered in partitions
+     * of kPartitionBytes, and full partitions are written by up to kMaxWriterThreads threads
+     * in parallel, so memory use stays bounded no matter how many keys are added. Nothing
+     * becomes visible before ingest() succeeds.
+     */
+    class RocksSstBulkLoader {
+        MONGO_DISALLOW_COPYING(RocksSstBulkLoader);
+
+    public:
+        // Files are written to a temporary directory named after 'name' in the DB directory
+        RocksSstBulkLoader(rocksdb::DB* db, const std::string& name);
+        // Waits for the writer threads and removes the temporary files
+        ~RocksSstBulkLoader();
+
+        // False if the linked RocksDB can't ingest external files
+        static bool isSupported();
+
+        // Removes temporary directories left behind by loaders that didn't finish, e.g. because
+        // of a crash
+        static void removeLeftovers(const std::string& dbPath);
+
+        // Keys have to be added in strictly increasing order
+        Status add(const rocksdb::Slice& key, const rocksdb::Slice& value);
+
+        // Writes out the remaining keys and ingests all files into the DB
+        Status ingest();
+
+    private:
+        struct Partition {
+            std::string data;
+            // {key size, value size} of the entries in data
+            std::vector<std::pair<uint32_t, uint32_t>> sizes;
+        };
+
+        void _flushPartition();
+        void _joinWriters(size_t maxRunning);
+        Status _getStatus();
+        static rocksdb::Status _writeFile(const rocksdb::Options& options,
+                                          const std::string& path, const Partition& partition);
+
+        static const size_t kPartitionBytes = 32 * 1024 * 1024;
+        static const size_t kMaxWriterThreads = 4;
+
+        rocksdb::DB* _db;  // not owned
+        const rocksdb::Options _options;
+        std::string _dir;
+        bool _dirCreated = false;
+
+        Partition _current;
+        std::vector<std::string> _files;
+        std::deque<stdx::thread> _writers;
+
+        stdx::mutex _statusMutex;
+        // first error of any writer, protected by _statusMutex
+        Status _status = Status::OK();
+    };
+
+}  // namespace mongo
@@ -125,17 +125,20 @@ namespace mongo {
 
     bool RocksTransaction::registerWrite(const std::string& key) {
         stdx::lock_guard<stdx::mutex> lk(_transactionEngine->_lock);
-        if (_transactionEngine->_isKeyCommittedAfterSnapshot_inlock(key, _snapshotId)) {
-            // write-committed write conflict
-            return false;
-        }
         auto uncommittedTransactionIter = _transactionEngine->_uncommittedTransactionId.find(key);
-        if (uncommittedTransactionIter != _transactionEngine->_uncommittedTransactionId.end() &&
-            uncommittedTransactionIter->second != _transactionId) {
+        if (uncommittedTransactionIter != _transactionEngine->_uncommittedTransactionId.end()) {
+            if (uncommittedTransactionIter->second == _transactionId) {
+                // we wrote it before, so it's already in _writtenKeys
+                return true;
+            }
             // write-uncommitted write conflict
             return false;
         }
-        _writtenKeys.insert(key);
+        if (_transactionEngine->_isKeyCommittedAfterSnapshot_inlock(key, _snapshotId)) {
+            // write-committed write conflict
+            return false;
+        }
+        _writtenKeys.push_back(key);
         _transactionEngine->_uncommittedTransactionId[key] = _transactionId;
         return true;
     }
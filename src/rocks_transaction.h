@@ -34,6 +34,7 @@
 #include <memory>
 #include <string>
 #include <list>
+#include <vector>
 
 #include "mongo/stdx/mutex.h"
 
@@ -132,6 +133,7 @@ namespace mongo {
         std::list<uint64_t>::iterator _activeSnapshotsIter;
         uint64_t _transactionId;
         RocksTransactionEngine* _transactionEngine;
-        std::set<std::string> _writtenKeys;
+        // without duplicates, see registerWrite()
+        std::vector<std::string> _writtenKeys;
     };
 }
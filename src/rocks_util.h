@@ -35,16 +35,21 @@
 
 namespace mongo {
 
-    inline std::string rocksGetNextPrefix(const rocksdb::Slice& prefix) {
-        // next prefix lexicographically, assume same length
-        std::string nextPrefix(prefix.data(), prefix.size());
-        for (int i = static_cast<int>(nextPrefix.size()) - 1; i >= 0; --i) {
-            nextPrefix[i]++;
+    // Turns *prefix into the next prefix lexicographically, of the same length
+    inline void rocksSetNextPrefix(std::string* prefix) {
+        for (int i = static_cast<int>(prefix->size()) - 1; i >= 0; --i) {
+            (*prefix)[i]++;
             // if it's == 0, that means we've overflowed, so need to keep adding
-            if (nextPrefix[i] != 0) {
+            if ((*prefix)[i] != 0) {
                 break;
             }
         }
+    }
+
+    inline std::string rocksGetNextPrefix(const rocksdb::Slice& prefix) {
+        // next prefix lexicographically, assume same length
+        std::string nextPrefix(prefix.data(), prefix.size());
+        rocksSetNextPrefix(&nextPrefix);
         return nextPrefix;
     }
 
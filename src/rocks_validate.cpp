@@ -0,0 +1,264 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#define MONGO_LOG_DEFAULT_COMPONENT ::mongo::logger::LogComponent::kStorage
+
+#include "mongo/platform/basic.h"
+
+#include "rocks_validate.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <rocksdb/convenience.h>
+#include <rocksdb/iterator.h>
+#include <rocksdb/options.h>
+#include <rocksdb/version.h>
+
+#include "mongo/db/operation_context.h"
+#include "mongo/util/assert_util.h"
+#include "mongo/util/log.h"
+
+#include "rocks_util.h"
+
+namespace mongo {
+
+    namespace {
+        // calls f for every live SST file of cf that overlaps [begin, end)
+        template <typename F>
+        void forEachOverlappingFile(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                    const std::string& begin, const std::string& end, F f) {
+            const rocksdb::Comparator* cmp = db->GetOptions(cf).comparator;
+            std::vector<rocksdb::LiveFileMetaData> files;
+            db->GetLiveFilesMetaData(&files);
+            for (const auto& file : files) {
+                if (file.column_family_name != cf->GetName()) {
+                    continue;
+                }
+                if ((!begin.empty() && cmp->Compare(file.largestkey, begin) < 0) ||
+                    (!end.empty() && cmp->Compare(file.smallestkey, end) >= 0)) {
+                    continue;
+                }
+                f(file, cmp);
+            }
+        }
+    }  // namespace
+
+    std::vector<std::string> rocksSplitRangeBySstFiles(rocksdb::DB* db,
+                                                       rocksdb::ColumnFamilyHandle* cf,
+                                                       const std::string& begin,
+                                                       const std::string& end, int parts) {
+        if (cf == nullptr) {
+            cf = db->DefaultColumnFamily();
+        }
+
+        uint64_t totalBytes = 0;
+        const rocksdb::Comparator* cmp = nullptr;
+        std::vector<std::pair<std::string, uint64_t>> starts;
+        forEachOverlappingFile(db, cf, begin, end, [&](const rocksdb::LiveFileMetaData& file,
+                                                       const rocksdb::Comparator* c) {
+            cmp = c;
+            totalBytes += file.size;
+            if (cmp->Compare(file.smallestkey, begin) > 0) {
+                starts.emplace_back(file.smallestkey, file.size);
+            }
+        });
+
+        std::vector<std::string> splits;
+        if (parts <= 1 || starts.empty()) {
+            return splits;
+        }
+        std::sort(starts.begin(), starts.end(),
+                  [cmp](const std::pair<std::string, uint64_t>& a,
+                        const std::pair<std::string, uint64_t>& b) {
+                      return cmp->Compare(a.first, b.first) < 0;
+                  });
+
+        // files starting before 'begin' belong to the first range
+        uint64_t bytesBefore = totalBytes;
+        for (const auto& start : starts) {
+            bytesBefore -= start.second;
+        }
+        const uint64_t bytesPerPart = std::max<uint64_t>(totalBytes / parts, 1);
+        for (const auto& start : starts) {
+            if (static_cast<int>(splits.size()) == parts - 1) {
+                break;
+            }
+            if (bytesBefore >= bytesPerPart * (splits.size() + 1) &&
+                (splits.empty() || cmp->Compare(splits.back(), start.first) < 0)) {
+                splits.push_back(start.first);
+            }
+            bytesBefore += start.second;
+        }
+        return splits;
+    }
+
+    RocksParallelScan::RocksParallelScan(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                         const rocksdb::Snapshot* snapshot, std::string begin,
+                                         std::string end, int numThreads, Callback callback)
+        : _db(db),
+          _cf(cf ? cf : db->DefaultColumnFamily()),
+          _snapshot(snapshot),
+          _callback(std::move(callback)) {
+        _bounds.push_back(begin);
+        for (auto& split : rocksSplitRangeBySstFiles(db, _cf, begin, end, numThreads)) {
+            _bounds.push_back(std::move(split));
+        }
+        _bounds.push_back(std::move(end));
+        const size_t numRanges = _bounds.size() - 1;
+
+        _running = numRanges;
+        try {
+            _threads.reserve(numRanges);
+            for (size_t i = 0; i < numRanges; ++i) {
+                _threads.emplace_back(&RocksParallelScan::_scanRange, this, i);
+            }
+        } catch (...) {
+            // the ranges that didn't get a thread will never finish
+            {
+                stdx::lock_guard<stdx::mutex> lk(_mutex);
+                _running -= numRanges - _threads.size();
+            }
+            _join();
+            throw;
+        }
+    }
+
+    RocksParallelScan::~RocksParallelScan() {
+        _join();
+    }
+
+    void RocksParallelScan::stop() {
+        _stop.store(true);
+    }
+
+    bool RocksParallelScan::waitFor(stdx::chrono::milliseconds timeout) {
+        stdx::unique_lock<stdx::mutex> lk(_mutex);
+        return _doneCV.wait_for(lk, timeout, [this] { return _running == 0; });
+    }
+
+    Status RocksParallelScan::getStatus() {
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        invariant(_running == 0);
+        return _firstError;
+    }
+
+    void RocksParallelScan::_join() {
+        stop();
+        for (auto& thread : _threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    void RocksParallelScan::_scanRange(size_t range) {
+        Status status = Status::OK();
+        try {
+            rocksdb::ReadOptions options;
+            options.snapshot = _snapshot;
+            // don't trash the block cache with a full scan
+            options.fill_cache = false;
+            options.total_order_seek = true;
+            rocksdb::Slice upperBound(_bounds[range + 1]);
+            if (!_bounds[range + 1].empty()) {
+                options.iterate_upper_bound = &upperBound;
+            }
+            std::unique_ptr<rocksdb::Iterator> it(_db->NewIterator(options, _cf));
+            for (it->Seek(_bounds[range]); it->Valid() && !_stop.load(std::memory_order_relaxed);
+                 it->Next()) {
+                _callback(range, it->key(), it->value());
+            }
+            status = rocksToMongoStatus(it->status());
+        } catch (const DBException& e) {
+            status = e.toStatus();
+        } catch (const std::exception& e) {
+            status = Status(ErrorCodes::UnknownError, e.what());
+        }
+
+        if (!status.isOK()) {
+            // no point in scanning the other ranges
+            stop();
+        }
+        stdx::lock_guard<stdx::mutex> lk(_mutex);
+        if (!status.isOK() && _firstError.isOK()) {
+            _firstError = status;
+        }
+        --_running;
+        _doneCV.notify_all();
+    }
+
+    Status rocksParallelScan(OperationContext* opCtx, rocksdb::DB* db,
+                             rocksdb::ColumnFamilyHandle* cf, const rocksdb::Snapshot* snapshot,
+                             const std::string& begin, const std::string& end, int numThreads,
+                             const RocksParallelScan::Callback& callback) {
+        RocksParallelScan scan(db, cf, snapshot, begin, end, numThreads, callback);
+        while (!scan.waitFor(stdx::chrono::milliseconds(100))) {
+            Status interruptStatus = opCtx->checkForInterruptNoAssert();
+            if (!interruptStatus.isOK()) {
+                // the destructor stops and joins the threads
+                return interruptStatus;
+            }
+        }
+        return scan.getStatus();
+    }
+
+    Status rocksVerifySstChecksumsInRange(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                          const std::string& begin, const std::string& end,
+                                          long long* numFilesOut) {
+        *numFilesOut = 0;
+#if ROCKSDB_MAJOR > 5 || (ROCKSDB_MAJOR == 5 && ROCKSDB_MINOR >= 12)
+        if (cf == nullptr) {
+            cf = db->DefaultColumnFamily();
+        }
+        const rocksdb::Options options = db->GetOptions(cf);
+        const rocksdb::EnvOptions envOptions;
+
+        Status status = Status::OK();
+        forEachOverlappingFile(db, cf, begin, end, [&](const rocksdb::LiveFileMetaData& file,
+                                                       const rocksdb::Comparator*) {
+            if (!status.isOK()) {
+                return;
+            }
+            const std::string path = file.db_path + file.name;
+            auto s = rocksdb::VerifySstFileChecksum(options, envOptions, path);
+            if (!s.ok()) {
+                status = rocksToMongoStatus(s, path.c_str());
+                return;
+            }
+            ++(*numFilesOut);
+        });
+        return status;
+#else
+        return Status(ErrorCodes::CommandNotSupported,
+                      "checksum validation requires RocksDB 5.12 or newer");
+#endif
+    }
+
+}  // namespace mongo
@@ -0,0 +1,130 @@
+/**
+ *    Copyright (C) 2017 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <rocksdb/db.h>
+#include <rocksdb/slice.h>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/base/status.h"
+#include "mongo/stdx/chrono.h"
+#include "mongo/stdx/condition_variable.h"
+#include "mongo/stdx/mutex.h"
+#include "mongo/stdx/thread.h"
+
+namespace mongo {
+
+    class OperationContext;
+
+    /**
+     * Splits [begin, end) into at most 'parts' ranges holding about the same amount of SST data.
+     * Returns the split points, in increasing order. Returns fewer split points if there are not
+     * enough SST files in the range. cf can be nullptr for the default column family.
+     */
+    std::vector<std::string> rocksSplitRangeBySstFiles(rocksdb::DB* db,
+                                                       rocksdb::ColumnFamilyHandle* cf,
+                                                       const std::string& begin,
+                                                       const std::string& end, int parts);
+
+    /**
+     * Scans [begin, end) as of 'snapshot' with up to 'numThreads' threads, each reading one
+     * range. 'callback' runs on the scanning threads and gets the index of the range it's
+     * called for, which is below numThreads. Each range is scanned by a single thread, so
+     * callers can keep per-range state without locking. An exception thrown by 'callback' stops
+     * the scan and becomes its status.
+     *
+     * The threads start in the constructor. The destructor stops and joins them, so an
+     * exception on the calling thread doesn't leave them running.
+     */
+    class RocksParallelScan {
+        MONGO_DISALLOW_COPYING(RocksParallelScan);
+
+    public:
+        typedef std::function<void(size_t range, const rocksdb::Slice& key,
+                                   const rocksdb::Slice& value)>
+            Callback;
+
+        RocksParallelScan(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                          const rocksdb::Snapshot* snapshot, std::string begin, std::string end,
+                          int numThreads, Callback callback);
+        ~RocksParallelScan();
+
+        // Makes the threads stop after the key they're currently at
+        void stop();
+
+        // Returns true if all ranges were scanned (or the scan stopped) within the timeout
+        bool waitFor(stdx::chrono::milliseconds timeout);
+
+        // The first error any of the threads ran into. Only valid once waitFor() returned true.
+        Status getStatus();
+
+    private:
+        void _scanRange(size_t range);
+        void _join();
+
+        rocksdb::DB* const _db;                   // not owned
+        rocksdb::ColumnFamilyHandle* const _cf;  // not owned
+        const rocksdb::Snapshot* const _snapshot;  // not owned
+        const Callback _callback;
+        std::vector<std::string> _bounds;
+
+        std::atomic<bool> _stop{false};
+        stdx::mutex _mutex;
+        stdx::condition_variable _doneCV;
+        // protected by _mutex
+        size_t _running = 0;
+        Status _firstError = Status::OK();
+
+        std::vector<stdx::thread> _threads;
+    };
+
+    /**
+     * Runs a RocksParallelScan to completion. The calling thread waits for the scan and checks
+     * opCtx for interrupts; if it gets interrupted the scan stops and the interrupt status is
+     * returned.
+     */
+    Status rocksParallelScan(OperationContext* opCtx, rocksdb::DB* db,
+                             rocksdb::ColumnFamilyHandle* cf, const rocksdb::Snapshot* snapshot,
+                             const std::string& begin, const std::string& end, int numThreads,
+                             const RocksParallelScan::Callback& callback);
+
+    /**
+     * Verifies the block checksums of all live SST files overlapping [begin, end), without
+     * decoding any records. Data that is still in memtables is not covered.
+     */
+    Status rocksVerifySstChecksumsInRange(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf,
+                                          const std::string& begin, const std::string& end,
+                                          long long* numFilesOut);
+
+}  // namespace mongo